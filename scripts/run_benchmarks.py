@@ -0,0 +1,182 @@
+#!/usr/bin/env python3
+
+from argparse import ArgumentParser
+import json
+from os import listdir
+from os.path import abspath, basename, isfile, join, splitext
+from statistics import median, stdev
+from subprocess import PIPE, run
+import sys
+from time import perf_counter
+
+import term
+
+# Runs the benchmarks, optionally comparing them to a baseline.
+#
+# Each benchmark script is run a few times to warm up the caches, then
+# repeatedly timed. The wall time of the whole process is measured, and the
+# script output must not contain "false", which benchmarks print to report
+# wrong results.
+
+parser = ArgumentParser()
+parser.add_argument("cli_app")
+parser.add_argument("benchmark_root")
+parser.add_argument("--no_colors", action="store_true")
+parser.add_argument("--cli_option", action="append", default=[])
+parser.add_argument("--warmups", type=int, default=1)
+parser.add_argument("--repeats", type=int, default=5)
+parser.add_argument("--output", help="write the results to a JSON file")
+parser.add_argument("--baseline", help="JSON results to compare with")
+parser.add_argument(
+    "--threshold",
+    type=float,
+    default=10.0,
+    help="slowdown in percent of the median above which a benchmark is a "
+    "regression",
+)
+parser.add_argument("filter", nargs="?")
+args = parser.parse_args(sys.argv[1:])
+
+if not isfile(args.cli_app):
+    print("File not found: " + args.cli_app)
+    sys.exit(1)
+
+
+def green(txt):
+    if args.no_colors:
+        return txt
+    return term.green(txt)
+
+
+def red(txt):
+    if args.no_colors:
+        return txt
+    return term.red(txt)
+
+
+def gray(txt):
+    if args.no_colors:
+        return txt
+    return term.gray(txt)
+
+
+def run_once(path):
+    """
+    Runs the script at [path], and returns its wall time in seconds or None
+    if it failed.
+    """
+
+    start = perf_counter()
+    proc = run(
+        [args.cli_app] + args.cli_option + [path],
+        stdout=PIPE,
+        stderr=PIPE,
+        text=True,
+    )
+    elapsed = perf_counter() - start
+    if proc.returncode != 0 or "false" in proc.stdout.split():
+        term.print_line(red("FAIL") + ": " + path)
+        print("")
+        for line in (proc.stdout + proc.stderr).splitlines()[:10]:
+            print("    " + term.pink(line))
+        return None
+    return elapsed
+
+
+def run_benchmark(path):
+    for _ in range(args.warmups):
+        if run_once(path) is None:
+            return None
+    samples = []
+    for _ in range(args.repeats):
+        elapsed = run_once(path)
+        if elapsed is None:
+            return None
+        samples.append(elapsed)
+    return {
+        "median": median(samples),
+        "stddev": stdev(samples) if len(samples) > 1 else 0.0,
+        "min": min(samples),
+        "max": max(samples),
+        "samples": samples,
+    }
+
+
+def compare(result, baseline):
+    """
+    Returns the comparison of [result] with its [baseline] as text, and
+    whether it is a regression.
+    """
+
+    if baseline is None:
+        return gray("no baseline"), False
+    change = (result["median"] / baseline["median"] - 1.0) * 100.0
+    text = "{:+.1f}%".format(change)
+    if change > args.threshold:
+        return red(text), True
+    if change < -args.threshold:
+        return green(text), False
+    return text, False
+
+
+baseline = {}
+if args.baseline:
+    with open(args.baseline, "r") as file:
+        baseline = json.load(file)["benchmarks"]
+
+paths = sorted(
+    join(abspath(args.benchmark_root), file)
+    for file in listdir(args.benchmark_root)
+    if splitext(file)[1] == ".tx"
+)
+if args.filter:
+    paths = [path for path in paths if basename(path).startswith(args.filter)]
+
+results = {}
+failed = 0
+regressions = 0
+for path in paths:
+    name = splitext(basename(path))[0]
+    term.print_line("Running {}".format(gray("({})".format(name))))
+    result = run_benchmark(path)
+    if result is None:
+        failed += 1
+        continue
+    results[name] = result
+    comparison, is_regression = compare(result, baseline.get(name))
+    if is_regression:
+        regressions += 1
+    term.print_line(
+        "{:<24} median {:8.4f} s  stddev {:7.4f} s  {}\n".format(
+            name, result["median"], result["stddev"], comparison
+        )
+    )
+term.print_line()
+
+if args.output:
+    with open(args.output, "w") as file:
+        json.dump(
+            {
+                "cli_app": args.cli_app,
+                "cli_options": args.cli_option,
+                "warmups": args.warmups,
+                "repeats": args.repeats,
+                "benchmarks": results,
+            },
+            file,
+            indent=2,
+        )
+        file.write("\n")
+
+if failed != 0:
+    print("{} benchmarks failed.".format(red(failed)))
+if regressions != 0:
+    print(
+        "{} benchmarks regressed by more than {}%.".format(
+            red(regressions), args.threshold
+        )
+    )
+if failed != 0 or regressions != 0:
+    sys.exit(1)
+
+print("All {} benchmarks ran.".format(green(len(results))))
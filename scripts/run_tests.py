@@ -13,8 +13,9 @@ from os.path import (
     isfile,
 )
 import re
-from subprocess import Popen, PIPE
+from subprocess import DEVNULL, Popen, PIPE, run
 import sys
+from tempfile import TemporaryDirectory
 
 import term
 
@@ -24,6 +25,12 @@ parser = ArgumentParser()
 parser.add_argument("cli_app")
 parser.add_argument("suite_root")
 parser.add_argument("--no_colors", action="store_true")
+parser.add_argument("--cli_option", action="append", default=[])
+parser.add_argument(
+    "--image",
+    action="store_true",
+    help="run tests from precompiled bytecode images",
+)
 parser.add_argument("filter", nargs="?")
 args = parser.parse_args(sys.argv[1:])
 
@@ -33,6 +40,7 @@ CLI_APP = args.cli_app
 TESTS_DIR = args.suite_root
 
 CLI_APP_WITH_EXT = CLI_APP
+CLI_OPTIONS = args.cli_option
 # if platform.system() == "Windows":
 #     CLI_APP_WITH_EXT += ".exe"
 
@@ -150,9 +158,26 @@ class Test:
             return True
 
     def run(self):
+        if args.image:
+            with TemporaryDirectory() as tmp_dir:
+                self.run_path(self.compile_image(tmp_dir))
+        else:
+            self.run_path(self.path)
+
+    def compile_image(self, tmp_dir):
+        # Tests expecting compile errors are run from source.
+        image_path = join(tmp_dir, "test.txc")
+        args = [CLI_APP_WITH_EXT]
+        args.extend(CLI_OPTIONS)
+        args.extend(["--compile", image_path, self.path])
+        proc = run(args, stdout=DEVNULL, stderr=DEVNULL)
+        return image_path if proc.returncode == 0 else self.path
+
+    def run_path(self, path):
         # Invoke the interpreter and run the test.
         args = [CLI_APP_WITH_EXT]
-        args.append(self.path)
+        args.extend(CLI_OPTIONS)
+        args.append(path)
         proc = Popen(args, stdin=PIPE, stdout=PIPE, stderr=PIPE)
 
         out, err = proc.communicate()
@@ -0,0 +1,31 @@
+# Runs the CLI with the arguments following "--" and checks both its standard
+# output and its exit code, PASS_REGULAR_EXPRESSION ignoring the latter
+#
+# cmake -DTX=<tx> -DEXPECTED_OUTPUT=<output> -DEXPECTED_RESULT=<code>
+#   -P check_cli.cmake -- <args>...
+#
+# Newlines are written "\n" in EXPECTED_OUTPUT
+
+set(args "")
+set(is_arg FALSE)
+math(EXPR last "${CMAKE_ARGC} - 1")
+foreach(i RANGE ${last})
+  if(is_arg)
+    list(APPEND args "${CMAKE_ARGV${i}}")
+  elseif(CMAKE_ARGV${i} STREQUAL "--")
+    set(is_arg TRUE)
+  endif()
+endforeach()
+
+execute_process(
+  COMMAND ${TX} ${args}
+  OUTPUT_VARIABLE output
+  RESULT_VARIABLE result
+)
+string(REPLACE "\\n" "\n" expected_output "${EXPECTED_OUTPUT}")
+if(NOT output STREQUAL expected_output)
+  message(FATAL_ERROR "Unexpected output:\n${output}")
+endif()
+if(NOT result STREQUAL EXPECTED_RESULT)
+  message(FATAL_ERROR "Exit code ${result}, expected ${EXPECTED_RESULT}")
+endif()
@@ -0,0 +1,216 @@
+#include "tx/tx.hxx"
+
+#include <catch2/catch.hpp>
+#include <fmt/format.h>
+
+#include <cstddef>
+#include <memory_resource>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Micro benchmarks of the runtime building blocks, run with the
+// `run_benchmarks` target or directly, e.g. `micro_benchmarks "[hash_map]"`.
+
+namespace {
+
+constexpr std::size_t KEY_COUNT = 4096;
+
+using IntHashMap = tx::HashMap<tx::i64, tx::i64, -1, 0, -2>;
+using IntSwissMap = tx::SwissMap<tx::i64, tx::i64, -1, 0, -2>;
+
+// Source exercising most of the grammar, repeated to get a sizeable input
+constexpr std::string_view SOURCE_SNIPPET = R"(
+fn fib(n: Int) Int {
+  if (n < 2) { return n; }
+  fib(n - 2) + fib(n - 1)
+}
+
+fn make_counter(step: Int) Fn<<>, Int> {
+  var count = 0;
+  fn counter() Int {
+    count = count + step;
+    count
+  }
+  counter
+}
+
+var counter = make_counter(2);
+var total = 0.5;
+var i = 0;
+while (i < 100) {
+  if (i == 50 or total > 1000.0) { break; }
+  total = total + 1.5 * 2.0 - 0.5;
+  i = i + 1;
+}
+std_println("fib");
+std_println(fib(10) + counter());
+)";
+
+std::string make_source(std::size_t repeat) {
+    std::string source;
+    for (std::size_t i = 0; i < repeat; ++i) {
+        // Distinct names so that globals are not redefined
+        source += fmt::format(
+            "{{\n{:s}\n}}\nvar global_{:d} = {:d};\n",
+            SOURCE_SNIPPET,
+            i,
+            i
+        );
+    }
+    return source;
+}
+
+std::vector<std::string> make_keys(std::size_t count) {
+    std::vector<std::string> keys;
+    keys.reserve(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        keys.push_back(fmt::format("identifier_{:d}", i));
+    }
+    return keys;
+}
+
+tx::VMOptions make_options() {
+    tx::VMOptions options;
+    options.allow_global_redefinition = true;
+    return options;
+}
+
+}  // namespace
+
+TEMPLATE_TEST_CASE("HashMap", "[hash_map]", IntHashMap, IntSwissMap) {
+    tx::VM tvm(make_options(), std::pmr::get_default_resource());
+
+    BENCHMARK("insert 4096 keys") {
+        TestType map;
+        for (std::size_t i = 0; i < KEY_COUNT; ++i) {
+            map.set(tvm, static_cast<tx::i64>(i), static_cast<tx::i64>(i));
+        }
+        const auto last = *map.get(static_cast<tx::i64>(KEY_COUNT - 1));
+        map.destroy(tvm);
+        return last;
+    };
+
+    TestType map;
+    for (std::size_t i = 0; i < KEY_COUNT; ++i) {
+        map.set(tvm, static_cast<tx::i64>(i * 2), static_cast<tx::i64>(i));
+    }
+    REQUIRE(*map.get(2) == 1);
+    REQUIRE(map.get(1) == nullptr);
+
+    BENCHMARK("lookup 4096 hits") {
+        tx::i64 sum = 0;
+        for (std::size_t i = 0; i < KEY_COUNT; ++i) {
+            sum += *map.get(static_cast<tx::i64>(i * 2));
+        }
+        return sum;
+    };
+
+    BENCHMARK("lookup 4096 misses") {
+        std::size_t found = 0;
+        for (std::size_t i = 0; i < KEY_COUNT; ++i) {
+            if (map.get(static_cast<tx::i64>(i * 2 + 1)) != nullptr) {
+                ++found;
+            }
+        }
+        return found;
+    };
+
+    BENCHMARK("erase and insert 4096 keys") {
+        for (std::size_t i = 0; i < KEY_COUNT; ++i) {
+            const auto key = static_cast<tx::i64>(i * 2);
+            (void)map.erase(key);
+            (void)map.set(tvm, key, static_cast<tx::i64>(i));
+        }
+        return *map.get(0);
+    };
+
+    map.destroy(tvm);
+}
+
+TEST_CASE("make_string", "[make_string]") {
+    tx::VM tvm(make_options(), std::pmr::get_default_resource());
+    const auto keys = make_keys(KEY_COUNT);
+
+    // Strings are only weakly referenced by the intern table, so they are
+    // allocated anew in the runs following each collection
+    BENCHMARK("intern 4096 short lived strings") {
+        std::size_t length = 0;
+        for (const auto& key : keys) {
+            length += static_cast<std::size_t>(
+                tx::make_string(tvm, true, key)->length
+            );
+        }
+        return length;
+    };
+
+    // Keep them alive in globals to measure the hits
+    std::string source;
+    for (const auto& key : keys) {
+        source += fmt::format("var {:s} = \"{:s}\";\n", key, key);
+    }
+    REQUIRE(tvm.interpret("strings.tx", source) == tx::InterpretResult::OK);
+    auto* first = tx::make_string(tvm, false, keys[0]);
+    REQUIRE(tx::make_string(tvm, false, keys[0]) == first);
+
+    BENCHMARK("lookup 4096 interned strings") {
+        std::size_t length = 0;
+        for (const auto& key : keys) {
+            length += static_cast<std::size_t>(
+                tx::make_string(tvm, false, key)->length
+            );
+        }
+        return length;
+    };
+}
+
+TEST_CASE("murmur3_32", "[murmur3_32]") {
+    const std::string short_key = "identifier";
+    const std::string long_key(std::size_t{4096}, 'x');
+    const auto as_bytes = [](const std::string& str) {
+        return std::span<const std::byte>(
+            static_cast<const std::byte*>(static_cast<const void*>(str.data())),
+            str.size()
+        );
+    };
+    REQUIRE(tx::murmur3_32(as_bytes(short_key)) != 0);
+
+    BENCHMARK("hash 10 bytes") { return tx::murmur3_32(as_bytes(short_key)); };
+
+    BENCHMARK("hash 4096 bytes") { return tx::murmur3_32(as_bytes(long_key)); };
+}
+
+TEST_CASE("Scanner::scan_token", "[scanner]") {
+    tx::VM tvm(make_options(), std::pmr::get_default_resource());
+    const auto source = make_source(64);
+
+    std::size_t errors = 0;
+    const auto scan_all = [&]() {
+        tx::Scanner scanner(tvm, source);
+        std::size_t count = 0;
+        for (;;) {
+            const auto token = scanner.scan_token();
+            if (token.type == tx::Token::END_OF_FILE) { break; }
+            if (token.type == tx::Token::ERROR) { ++errors; }
+            ++count;
+        }
+        return count;
+    };
+    REQUIRE(scan_all() > 0);
+    REQUIRE(errors == 0);
+
+    BENCHMARK(fmt::format("scan {:d} bytes", source.size())) {
+        return scan_all();
+    };
+}
+
+TEST_CASE("Parser::compile", "[parser]") {
+    tx::VM tvm(make_options(), std::pmr::get_default_resource());
+    const auto source = make_source(64);
+    REQUIRE(tvm.compile("benchmark.tx", source) != nullptr);
+
+    BENCHMARK(fmt::format("compile {:d} bytes", source.size())) {
+        return tvm.compile("benchmark.tx", source);
+    };
+}
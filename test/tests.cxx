@@ -1,5 +1,13 @@
+#include "tx/tx.hxx"
+
 #include <catch2/catch.hpp>
 
+#include <cstddef>
+#include <memory_resource>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
 unsigned int Factorial(unsigned int number) { // NOLINT(misc-no-recursion)
   return number <= 1 ? number : Factorial(number - 1) * number;
 }
@@ -10,3 +18,105 @@ TEST_CASE("Factorials are computed", "[factorial]") {
   REQUIRE(Factorial(3) == 6);
   REQUIRE(Factorial(10) == 3628800);
 }
+
+namespace {
+
+using IntHashMap = tx::HashMap<tx::i64, tx::i64, -1, 0, -2>;
+using IntSwissMap = tx::SwissMap<tx::i64, tx::i64, -1, 0, -2>;
+using Reference = std::unordered_map<tx::i64, tx::i64>;
+
+template <typename Map>
+void check_same(const Map& map, const Reference& reference) {
+    std::size_t count = 0;
+    for (const auto& entry : map) {
+        const auto iter = reference.find(entry.first);
+        REQUIRE(iter != reference.end());
+        REQUIRE(entry.second == iter->second);
+        ++count;
+    }
+    REQUIRE(count == reference.size());
+}
+
+// Random sets, erasures and lookups of keys in [0, key_range)
+template <typename Map>
+void run_random_ops(
+    tx::VM& tvm,
+    Map& map,
+    Reference& reference,
+    std::mt19937& rng,
+    tx::i64 key_range,
+    int set_percent,
+    int erase_percent
+) {
+    std::uniform_int_distribution<tx::i64> key_dist(0, key_range - 1);
+    std::uniform_int_distribution<int> op_dist(0, 99);
+    for (int i = 0; i < 200000; ++i) {
+        const auto key = key_dist(rng);
+        const auto oper = op_dist(rng);
+        if (oper < set_percent) {
+            const auto value = static_cast<tx::i64>(i);
+            const bool is_new = map.set(tvm, key, value);
+            REQUIRE(is_new == !reference.contains(key));
+            reference[key] = value;
+        } else if (oper < set_percent + erase_percent) {
+            REQUIRE(map.erase(key) == (reference.erase(key) == 1));
+        } else {
+            const auto* value = map.get(key);
+            const auto iter = reference.find(key);
+            if (iter == reference.end()) {
+                REQUIRE(value == nullptr);
+            } else {
+                REQUIRE(value != nullptr);
+                REQUIRE(*value == iter->second);
+            }
+        }
+    }
+}
+
+}  // namespace
+
+TEMPLATE_TEST_CASE(
+    "HashMap matches std::unordered_map",
+    "[hash_map]",
+    IntHashMap,
+    IntSwissMap
+) {
+    tx::VM tvm(tx::VMOptions{}, std::pmr::get_default_resource());
+    std::mt19937 rng(42);  // NOLINT(cert-msc32-c,cert-msc51-cpp)
+    TestType map;
+    Reference reference;
+
+    SECTION("growing") {
+        run_random_ops(tvm, map, reference, rng, 8192, 60, 10);
+        check_same(map, reference);
+    }
+
+    SECTION("erase heavy churn at a stable size") {
+        // Enough live keys to fill groups, with as many erasures as
+        // insertions so that the table is rehashed at the same capacity
+        run_random_ops(tvm, map, reference, rng, 4096, 60, 10);
+        run_random_ops(tvm, map, reference, rng, 4096, 45, 45);
+        check_same(map, reference);
+        run_random_ops(tvm, map, reference, rng, 4096, 20, 70);
+        check_same(map, reference);
+        run_random_ops(tvm, map, reference, rng, 4096, 70, 20);
+        check_same(map, reference);
+    }
+
+    SECTION("erasing while iterating") {
+        // As done for the intern table after each collection
+        run_random_ops(tvm, map, reference, rng, 4096, 60, 10);
+        for (auto& entry : map) {
+            if (entry.first % 3 != 0) {
+                const auto key = entry.first;
+                REQUIRE(map.erase(key));
+                reference.erase(key);
+            }
+        }
+        check_same(map, reference);
+        run_random_ops(tvm, map, reference, rng, 4096, 50, 30);
+        check_same(map, reference);
+    }
+
+    map.destroy(tvm);
+}
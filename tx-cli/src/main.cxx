@@ -2,12 +2,28 @@
 
 #include <fmt/format.h>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
 #include <cerrno>
+#include <charconv>
+#include <condition_variable>
 #include <cstdlib>
+#include <map>
+#include <memory>
 #include <memory_resource>
+#include <mutex>
+#include <optional>
 #include <ranges>
 #include <span>
+#include <string>
 #include <string_view>
+#include <thread>
+#include <vector>
 
 namespace tx {
 
@@ -16,6 +32,7 @@ static constexpr std::size_t REPL_LINE_MAX_LEN = 1024;
 constexpr std::string_view usage_str =
     R"(Usage:
   tx [OPTIONS] [-c cmd | file | -] [--] [arguments...]
+  tx [OPTIONS] --jobs N file...
   tx --help | --version
 Options:
   --help            Show this message and exit.
@@ -27,8 +44,22 @@ Options:
       -D print-bytecode   Print bytecode after compilation
       -D trace-execution  Trace bytecode execution
       -D trace-gc         Trace garbage collection
+  -O                Optimize bytecode after compilation.
+  --gc TXT          Garbage collector, 'generational' (default) or 'full'.
+  --jit TXT         Compile functions to native code, 'hot' (default),
+                    'force' or 'off'. (only works on builds with a JIT)
+  --memory-stats    Print memory statistics to stderr after execution.
+  -P TXT            Profile execution, write a summary to the given file and
+                    folded stacks for flamegraph tools to the same path with
+                    a '.folded' suffix.
+  --compile TXT     Compile file to a bytecode image (.txc) instead of
+                    executing it.
+  --jobs N          Run the files, scripts or images, on N threads. Each
+                    distinct file is compiled once and shared by its runs.
+                    Outputs are written in the order of the files.
   -c,--command TXT  Execute command passed as argument.
-  file TXT          Read script to execute from file.
+  file TXT          Read script or bytecode image (.txc) to execute from
+                    file.
   -                 Read script to execute from the standard input.
   --                Stop parsing the following arguments as options.
   arguments TXT...  Argument to pass to executed script/command.
@@ -61,7 +92,12 @@ struct ArgsOptions {
     bool help = false;
     bool version = false;
     bool use_stdin = false;
+    bool memory_stats = false;
     const char* file_path = nullptr;
+    const char* compile_output = nullptr;
+    const char* profile_output = nullptr;
+    // Run the files as a batch on that many threads, if not 0
+    std::size_t job_count = 0;
     std::string_view command;
     std::span<const char*> rest_of_args;
     tx::VMOptions vm_options;
@@ -113,6 +149,89 @@ parse_arguments(int argc, const char** argv) {
                 tx::print_usage();
                 return std::nullopt;
             }
+        } else if (arg == "-O") {
+            result.vm_options.optimize = true;
+        } else if (arg == "--gc") {
+            ++idx;
+            const std::string_view mode =
+                idx < args.size() ? args[idx] : std::string_view{};
+            if (mode == "generational") {
+                result.vm_options.gc_mode = tx::GCMode::GENERATIONAL;
+            } else if (mode == "full") {
+                result.vm_options.gc_mode = tx::GCMode::FULL;
+            } else {
+                fmt::print(
+                    stderr,
+                    FMT_STRING("Expecting 'generational' or 'full' after "
+                               "'--gc'.\n")
+                );
+                tx::print_usage();
+                return std::nullopt;
+            }
+        } else if (arg == "--jit") {
+            ++idx;
+            const std::string_view mode =
+                idx < args.size() ? args[idx] : std::string_view{};
+            if (mode == "hot") {
+                result.vm_options.jit_mode = tx::JitMode::HOT;
+            } else if (mode == "force") {
+                result.vm_options.jit_mode = tx::JitMode::FORCE;
+            } else if (mode == "off") {
+                result.vm_options.jit_mode = tx::JitMode::OFF;
+            } else {
+                fmt::print(
+                    stderr,
+                    FMT_STRING("Expecting 'hot', 'force' or 'off' after "
+                               "'--jit'.\n")
+                );
+                tx::print_usage();
+                return std::nullopt;
+            }
+        } else if (arg == "-P") {
+            ++idx;
+            if (idx >= args.size()) {
+                fmt::print(
+                    stderr,
+                    FMT_STRING("Expecting output file after '-P'.\n")
+                );
+                tx::print_usage();
+                return std::nullopt;
+            }
+            result.profile_output = args[idx];
+        } else if (arg == "--memory-stats") {
+            result.memory_stats = true;
+        } else if (arg == "--compile") {
+            ++idx;
+            if (idx >= args.size()) {
+                fmt::print(
+                    stderr,
+                    FMT_STRING("Expecting output file after '--compile'.\n")
+                );
+                tx::print_usage();
+                return std::nullopt;
+            }
+            result.compile_output = args[idx];
+        } else if (arg == "--jobs") {
+            ++idx;
+            const std::string_view count =
+                idx < args.size() ? args[idx] : std::string_view{};
+            std::size_t job_count = 0;
+            const auto [end, error] = std::from_chars(
+                count.data(),
+                count.data() + count.size(),
+                job_count
+            );
+            if (count.empty() || error != std::errc{}
+                || end != count.data() + count.size() || job_count == 0) {
+                fmt::print(
+                    stderr,
+                    FMT_STRING("Expecting a number of threads after "
+                               "'--jobs'.\n")
+                );
+                tx::print_usage();
+                return std::nullopt;
+            }
+            result.job_count = job_count;
         } else if (arg == "-c" or arg == "--command") {
             ++idx;
             if (idx >= args.size()) {
@@ -224,6 +343,313 @@ void run_file(VM& tvm, const char* path) {
     }
 }
 
+class MappedFile {
+    void* data_ptr = nullptr;
+    std::size_t length = 0;
+
+  public:
+    MappedFile() noexcept = default;
+
+    MappedFile(void* data, std::size_t len) noexcept
+            : data_ptr(data)
+            , length(len) {}
+
+    MappedFile(const MappedFile& other) = delete;
+
+    MappedFile(MappedFile&& other) noexcept
+            : data_ptr(std::exchange(other.data_ptr, nullptr))
+            , length(std::exchange(other.length, 0)) {}
+
+    ~MappedFile() noexcept {
+        if (data_ptr != nullptr) { (void)::munmap(data_ptr, length); }
+    }
+
+    MappedFile& operator=(const MappedFile& rhs) = delete;
+
+    MappedFile& operator=(MappedFile&& rhs) noexcept {
+        std::swap(data_ptr, rhs.data_ptr);
+        std::swap(length, rhs.length);
+        return *this;
+    }
+
+    [[nodiscard]] std::span<const char> get() const noexcept {
+        return {static_cast<const char*>(data_ptr), length};
+    }
+};
+
+[[nodiscard]] MappedFile map_file(const char* path) noexcept {
+    // NOLINTNEXTLINE(*-vararg)
+    const int fdesc = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (fdesc < 0) {
+        fmt::print(
+            stderr,
+            FMT_STRING("Could not open file \"{:s}\": {}\n"),
+            path,
+            // NOLINTNEXTLINE(concurrency-mt-unsafe)
+            std::strerror(errno)
+        );
+        exit(ExitCode::IO_ERROR);
+    }
+    struct stat file_stat {};
+    if (::fstat(fdesc, &file_stat) != 0 || !S_ISREG(file_stat.st_mode)) {
+        fmt::print(
+            stderr,
+            FMT_STRING("Could not read file \"{:s}\": {}\n"),
+            path,
+            // NOLINTNEXTLINE(concurrency-mt-unsafe)
+            std::strerror(errno == 0 ? EISDIR : errno)
+        );
+        (void)::close(fdesc);
+        exit(ExitCode::IO_ERROR);
+    }
+    const auto file_size = static_cast<std::size_t>(file_stat.st_size);
+    if (file_size == 0) {
+        (void)::close(fdesc);
+        return {};
+    }
+    void* data = ::mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fdesc, 0);
+    (void)::close(fdesc);
+    // NOLINTNEXTLINE(*-cstyle-cast,*-int-to-ptr)
+    if (data == MAP_FAILED) {
+        fmt::print(
+            stderr,
+            FMT_STRING("Could not map file \"{:s}\": {}\n"),
+            path,
+            // NOLINTNEXTLINE(concurrency-mt-unsafe)
+            std::strerror(errno)
+        );
+        exit(ExitCode::IO_ERROR);
+    }
+    return {data, file_size};
+}
+
+[[nodiscard]] bool is_image_path(std::string_view path) noexcept {
+    return path.ends_with(IMAGE_FILE_EXTENSION);
+}
+
+void run_image(VM& tvm, const char* path, const MappedFile& image) {
+    const InterpretResult result = tvm.interpret_image(path, image.get());
+    if (result == InterpretResult::COMPILE_ERROR) {
+        exit(ExitCode::DATA_ERROR);
+    }
+    if (result == InterpretResult::RUNTIME_ERROR) {
+        exit(ExitCode::SOFTWARE_INTERNAL_ERROR);
+    }
+}
+
+void compile_file(VM& tvm, const char* path, const char* output_path) {
+    const auto source = read_file(path);
+    const auto* function = tvm.compile(path, source);
+    if (function == nullptr) { exit(ExitCode::DATA_ERROR); }
+    gsl::owner<std::FILE*> file = std::fopen(output_path, "wb");
+    if (file == nullptr) {
+        fmt::print(
+            stderr,
+            FMT_STRING("Could not open file \"{:s}\": {}\n"),
+            output_path,
+            // NOLINTNEXTLINE(concurrency-mt-unsafe)
+            std::strerror(errno)
+        );
+        exit(ExitCode::IO_ERROR);
+    }
+    const bool is_written = write_image(tvm, *function, file);
+    if (std::fclose(file) != 0 || !is_written) {
+        fmt::print(
+            stderr,
+            FMT_STRING("Could not write file \"{:s}\": {}\n"),
+            output_path,
+            // NOLINTNEXTLINE(concurrency-mt-unsafe)
+            std::strerror(errno)
+        );
+        exit(ExitCode::IO_ERROR);
+    }
+}
+
+void print_memory_stats(const VM& tvm) {
+    static constexpr std::array<std::string_view, OBJ_TYPE_COUNT> type_names{
+        "closure",
+        "function",
+        "native",
+        "string",
+        "upvalue",
+        "int",
+    };
+    const auto stats = tvm.get_memory_stats();
+    (void)std::fflush(stdout);
+    fmt::print(
+        stderr,
+        FMT_STRING(
+            "-- Memory stats\n"
+            "   GC heap: {:d} bytes, next major collection at {:d} bytes\n"
+            "   GC: {:d} minor, {:d} major collections\n"
+        ),
+        stats.bytes_allocated,
+        stats.next_gc,
+        stats.minor_gc_count,
+        stats.major_gc_count
+    );
+    for (std::size_t i = 0; i < OBJ_TYPE_COUNT; ++i) {
+        const auto& objects = stats.objects.at(i);
+        fmt::print(
+            stderr,
+            FMT_STRING("   {:s}: {:d} live ({:d} bytes), {:d} allocated\n"),
+            type_names.at(i),
+            objects.count,
+            objects.bytes,
+            objects.allocation_count
+        );
+    }
+    fmt::print(
+        stderr,
+        FMT_STRING(
+            "   Allocator: {:d} allocations, {:d} frees, {:d} in place\n"
+            "   Allocator: {:d} bytes used, {:d} bytes reserved, "
+            "{:.1f}% fragmentation\n"
+        ),
+        stats.allocator.allocation_count,
+        stats.allocator.free_count,
+        stats.allocator.in_place_count,
+        stats.allocator.used_bytes,
+        stats.allocator.reserved_bytes,
+        stats.allocator.fragmentation() * 100.0  // NOLINT(*-magic-numbers)
+    );
+}
+
+void write_profile(const Profiler& profiler, const char* output_path) {
+    const auto write = [](const char* path, auto&& writer) {
+        gsl::owner<std::FILE*> file = std::fopen(path, "w");
+        if (file == nullptr) {
+            fmt::print(
+                stderr,
+                FMT_STRING("Could not open file \"{:s}\": {}\n"),
+                path,
+                // NOLINTNEXTLINE(concurrency-mt-unsafe)
+                std::strerror(errno)
+            );
+            exit(ExitCode::IO_ERROR);
+        }
+        writer(file);
+        (void)std::fclose(file);
+    };
+    write(output_path, [&](std::FILE* file) {
+        profiler.write_summary(file);
+    });
+    const auto folded_path = std::string(output_path) + ".folded";
+    write(folded_path.c_str(), [&](std::FILE* file) {
+        profiler.write_folded_stacks(file);
+    });
+}
+
+// Files run by --jobs, each is compiled once
+struct BatchProgram {
+    std::string source;
+    MappedFile image;
+    std::unique_ptr<Program> program;
+};
+
+struct BatchJob {
+    const char* path = nullptr;
+    // nullptr if the file failed to compile
+    const Program* program = nullptr;
+    std::string output;
+    ExitCode exit_code = ExitCode::SUCCESS;
+    bool is_done = false;
+};
+
+void run_batch_job(BatchJob& job, VMOptions options) noexcept {
+    if (job.program == nullptr) {
+        job.exit_code = ExitCode::DATA_ERROR;
+        return;
+    }
+    // Written directly to stdout if it cannot be buffered
+    char* buffer = nullptr;
+    std::size_t size = 0;
+    gsl::owner<std::FILE*> output = ::open_memstream(&buffer, &size);
+    options.output = output;
+    InterpretResult result{};
+    {
+        VM tvm(options, std::pmr::get_default_resource(), *job.program);
+        result = tvm.interpret_program();
+    }
+    if (output != nullptr) {
+        (void)std::fclose(output);
+        job.output.assign(buffer, size);
+        // NOLINTNEXTLINE(*-no-malloc,*-owning-memory)
+        std::free(buffer);
+    }
+    if (result == InterpretResult::RUNTIME_ERROR) {
+        job.exit_code = ExitCode::SOFTWARE_INTERNAL_ERROR;
+    }
+}
+
+[[nodiscard]] ExitCode run_batch(const ArgsOptions& args) {
+    std::vector<const char*> paths{args.file_path};
+    paths.insert(
+        paths.end(),
+        args.rest_of_args.begin(),
+        args.rest_of_args.end()
+    );
+    std::map<std::string_view, BatchProgram> programs;
+    std::vector<BatchJob> jobs(paths.size());
+    for (std::size_t i = 0; i < paths.size(); ++i) {
+        const char* path = paths[i];
+        auto [iter, is_new] = programs.try_emplace(path);
+        auto& entry = iter->second;
+        if (is_new) {
+            entry.program = std::make_unique<Program>(
+                args.vm_options,
+                std::pmr::get_default_resource()
+            );
+            bool is_compiled = false;
+            if (is_image_path(path)) {
+                entry.image = map_file(path);
+                is_compiled =
+                    entry.program->load_image(path, entry.image.get());
+            } else {
+                entry.source = read_file(path);
+                is_compiled = entry.program->compile(path, entry.source);
+            }
+            if (!is_compiled) { entry.program.reset(); }
+        }
+        jobs[i].path = path;
+        jobs[i].program = entry.program.get();
+    }
+
+    std::atomic<std::size_t> next_job{0};
+    std::mutex mutex;
+    std::condition_variable job_done;
+    const auto work = [&]() {
+        for (auto idx = next_job++; idx < jobs.size(); idx = next_job++) {
+            run_batch_job(jobs[idx], args.vm_options);
+            {
+                const std::lock_guard lock(mutex);
+                jobs[idx].is_done = true;
+            }
+            job_done.notify_all();
+        }
+    };
+    std::vector<std::thread> threads;
+    const auto thread_count = std::min(args.job_count, jobs.size());
+    for (std::size_t i = 0; i < thread_count; ++i) {
+        threads.emplace_back(work);
+    }
+
+    // Outputs are written as soon as the previous ones are, the exit code is
+    // the one of the first file that failed
+    auto exit_code = ExitCode::SUCCESS;
+    for (const auto& job : jobs) {
+        {
+            std::unique_lock lock(mutex);
+            job_done.wait(lock, [&job]() { return job.is_done; });
+        }
+        (void)std::fwrite(job.output.data(), 1, job.output.size(), stdout);
+        (void)std::fflush(stdout);
+        if (exit_code == ExitCode::SUCCESS) { exit_code = job.exit_code; }
+    }
+    for (auto& thread : threads) { thread.join(); }
+    return exit_code;
+}
+
 void run_repl(VM& tvm) {
     print_greeting();
     std::array<char, REPL_LINE_MAX_LEN> line{};
@@ -257,15 +683,34 @@ int main(int argc, const char** argv) noexcept {
         return to_underlying(tx::ExitCode::SUCCESS);
     }
 
-    std::pmr::unsynchronized_pool_resource mem_res;
-    std::pmr::memory_resource* mem_res_ptr = nullptr;
-    // TODO make option
-    if constexpr (tx::IS_DEBUG_BUILD) {
-        mem_res_ptr = std::pmr::get_default_resource();
-    } else {
-        mem_res_ptr = &mem_res;
+    if (args.job_count != 0) {
+        if (args.file_path == nullptr || args.use_stdin
+            || args.compile_output != nullptr || args.profile_output != nullptr
+            || args.memory_stats) {
+            fmt::print(
+                stderr,
+                FMT_STRING("'--jobs' only runs files, and cannot be used with "
+                           "'-c', '-', '--compile', '-P' or "
+                           "'--memory-stats'.\n")
+            );
+            tx::print_usage();
+            return to_underlying(tx::ExitCode::USAGE_ERROR);
+        }
+        return to_underlying(tx::run_batch(args));
     }
+
+    // The VM pools small blocks itself, and can only grow large blocks in
+    // place when using the default heap
+    std::pmr::memory_resource* mem_res_ptr = std::pmr::get_default_resource();
+    // Strings of a loaded image point into its mapping
+    tx::MappedFile image;
     tx::VM tvm(args.vm_options, mem_res_ptr);
+    // Allocated by the VM, destroyed before it
+    std::optional<tx::Profiler> profiler;
+    if (args.profile_output != nullptr) {
+        profiler.emplace(tvm);
+        tvm.set_profiler(&*profiler);
+    }
     if (args.file_path == nullptr) {
         tvm.get_options().allow_pointer_to_source_content = false;
         tvm.get_options().allow_global_redefinition = true;
@@ -276,9 +721,18 @@ int main(int argc, const char** argv) noexcept {
             fmt::print(
                 FMT_STRING("UNIMPLEMENTED: Cannot read from <stdin> yet.\n")
             );
+        } else if (args.compile_output != nullptr) {
+            tx::compile_file(tvm, args.file_path, args.compile_output);
+        } else if (tx::is_image_path(args.file_path)) {
+            image = tx::map_file(args.file_path);
+            tx::run_image(tvm, args.file_path, image);
         } else {
             tx::run_file(tvm, args.file_path);
         }
     }
+    if (args.memory_stats) { tx::print_memory_stats(tvm); }
+    if (args.profile_output != nullptr) {
+        tx::write_profile(*profiler, args.profile_output);
+    }
     return to_underlying(tx::ExitCode::SUCCESS);
 }
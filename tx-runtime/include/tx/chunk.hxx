@@ -80,13 +80,22 @@ inline constexpr size_t read_multibyte_operand(const ByteCode* ptr) noexcept {
     return size_cast(result);
 }
 
-inline constexpr std::tuple<bool, size_t, u8> read_closure_operand(
+// Each upvalue of a CLOSURE is a flags byte followed by the index of the
+// local or upvalue of the enclosing function it captures. The flags hold
+// whether it is a local, whether it is captured by copy, and the length of
+// the index.
+inline constexpr u8 CLOSURE_OPERAND_IS_LOCAL = 0b10000000U;
+inline constexpr u8 CLOSURE_OPERAND_IS_VALUE = 0b01000000U;
+inline constexpr u8 CLOSURE_OPERAND_LENGTH_MASK = 0b00111111U;
+
+inline constexpr std::tuple<bool, bool, size_t, u8> read_closure_operand(
     const ByteCode* ptr
 ) noexcept {
     u8 flags = ptr->as_u8();
     std::advance(ptr, 1);
-    const u8 length = flags & 0b01111111U;
-    const bool is_local = (flags & 0b10000000U) != 0U;
+    const u8 length = flags & CLOSURE_OPERAND_LENGTH_MASK;
+    const bool is_local = (flags & CLOSURE_OPERAND_IS_LOCAL) != 0U;
+    const bool is_value = (flags & CLOSURE_OPERAND_IS_VALUE) != 0U;
     assert(length >= 1);
     assert(length <= 3);
     auto index = [&]() {
@@ -95,7 +104,7 @@ inline constexpr std::tuple<bool, size_t, u8> read_closure_operand(
         if (length == 3) { return read_multibyte_operand<3>(ptr); }
         unreachable();
     }();
-    return std::make_tuple(is_local, index, 1 + length);
+    return std::make_tuple(is_local, is_value, index, 1 + length);
 }
 
 using ByteCodeArray = DynArray<ByteCode>;
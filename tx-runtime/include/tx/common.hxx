@@ -23,6 +23,19 @@ inline constexpr bool IS_DEBUG_BUILD = true;
 #define TX_VM_CONSTEXPR constexpr
 #endif
 
+// The JIT generates x86-64 code and maps it with Linux system calls, the
+// interpreter runs everything on other platforms
+#if defined(TX_ENABLE_JIT) && defined(__x86_64__) && defined(__linux__)
+#define TX_HAS_JIT
+#endif
+
+// NaN boxed values store pointers as integers, which is not constexpr
+#ifdef TX_ENABLE_NAN_BOXING
+#define TX_VALUE_CONSTEXPR
+#else
+#define TX_VALUE_CONSTEXPR constexpr
+#endif
+
 inline constexpr std::string_view VERSION = cmake::project_version;
 inline constexpr int VERSION_MAJOR = cmake::project_version_major;
 inline constexpr int VERSION_MINOR = cmake::project_version_minor;
@@ -31,6 +44,13 @@ inline constexpr int VERSION_TWEAK = cmake::project_version_tweak;
 inline constexpr std::string_view GIT_SHA = cmake::git_sha;
 
 inline constexpr bool HAS_DEBUG_FEATURES = cmake::has_debug_features;
+inline constexpr bool HAS_NAN_BOXING = cmake::has_nan_boxing;
+inline constexpr bool HAS_SWISS_TABLE = cmake::has_swiss_table;
+#ifdef TX_HAS_JIT
+inline constexpr bool HAS_JIT = true;
+#else
+inline constexpr bool HAS_JIT = false;
+#endif
 
 // NOTE: Configurable, make cmake options
 // FIXME: Better naming
@@ -38,6 +58,10 @@ inline constexpr size_t START_FRAMES = 64;
 inline constexpr size_t MAX_FRAMES = 1U << 10U;
 inline constexpr size_t START_STACK = START_FRAMES * 256;
 inline constexpr size_t START_GC = size_t{1024} * 1024;
+inline constexpr size_t GC_HEAP_GROW_FACTOR = 2;
+inline constexpr size_t GC_NURSERY_SIZE = size_t{256} * 1024;
+// Calls and loop iterations after which a function is compiled by the JIT
+inline constexpr size_t JIT_HOT_THRESHOLD = 1000;
 
 // NOTE: Not configurable, do not edit values
 inline constexpr size_t MAX_LOCALS = 1U << 24U;
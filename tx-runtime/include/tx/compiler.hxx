@@ -55,6 +55,15 @@ struct ParseRule {
     Precedence precedence;
 };
 
+// Function a variable is known to hold when it is called, lets the compiler
+// emit calls without type and arity checks
+enum struct FunctionKind : u8 {
+    UNKNOWN,
+    // Constant defined by a fn declaration with a body
+    CLOSURE,
+    NATIVE,
+};
+
 struct Local {
     static constexpr bool IS_TRIVIALLY_RELOCATABLE = true;
 
@@ -62,6 +71,9 @@ struct Local {
     i32 depth{0};
     bool is_captured{false};
     bool is_const{true};
+    // Function whose body is being compiled, its slot does not hold it yet
+    bool is_defining{false};
+    FunctionKind function_kind{FunctionKind::UNKNOWN};
     TypeSet type_set{};
 
     Local(const Token& name_, i32 dpth, bool is_constant, TypeSet&& types)
@@ -78,6 +90,7 @@ struct Global {
 
     bool is_defined{false};
     bool is_const{true};
+    FunctionKind function_kind{FunctionKind::UNKNOWN};
     TypeSet type_set{};
 
     friend constexpr bool operator==(const Global& lhs, const Global& rhs) {
@@ -101,10 +114,13 @@ struct Upvalue {
 
     size_t index;
     bool is_local;
+    // Captured by copy, the variable is never written after being captured
+    bool is_value;
 
-    constexpr Upvalue(size_t idx, bool is_local_) noexcept
+    constexpr Upvalue(size_t idx, bool is_local_, bool is_value_) noexcept
             : index(idx)
-            , is_local(is_local_) {}
+            , is_local(is_local_)
+            , is_value(is_value_) {}
 };
 
 enum struct FunctionType {
@@ -128,6 +144,9 @@ struct Compiler {
     i32 scope_depth{0};
     i32 num_slots{0};
     Loop* innermost_loop = nullptr;
+    // Offset of the last CALL, turned into a TAIL_CALL when directly
+    // followed by a RETURN
+    size_t last_call_offset{-1};
 
     constexpr void destroy(VM& tvm) noexcept {
         constant_indices.destroy(tvm);
@@ -170,6 +189,10 @@ class Parser {
     bool previous_statement_was_cut_short{false};
     Compiler* current_compiler{nullptr};
     std::string_view module_file_path;
+    // Callee of the call being parsed, when known at compile time. Set by
+    // named_variable and consumed by call.
+    FunctionKind callee_kind{FunctionKind::UNKNOWN};
+    i32 callee_global_idx{-1};
 
   public:
     constexpr explicit Parser(VM& tvm) noexcept : parent_vm(tvm) {}
@@ -242,11 +265,15 @@ class Parser {
 
     constexpr void emit_constant(Value value) noexcept;
 
-    constexpr void
+    TX_VALUE_CONSTEXPR void
     emit_closure(Compiler& compiler, ObjFunction& function) noexcept;
 
     constexpr void emit_var_length_instruction(OpCode opc, size_t idx) noexcept;
 
+    constexpr void
+    emit_call(FunctionKind kind, i32 global_idx, size_t arg_count) noexcept;
+    constexpr void emit_return() noexcept;
+
     [[nodiscard]] constexpr size_t emit_jump(OpCode instruction) noexcept;
 
     constexpr void emit_loop(size_t loop_start) noexcept;
@@ -270,7 +297,12 @@ class Parser {
     resolve_local(Compiler& compiler, const Token& name) noexcept;
 
     [[nodiscard]] constexpr size_t
-    add_upvalue(Compiler& compiler, size_t index, bool is_local) noexcept;
+    add_upvalue(
+        Compiler& compiler,
+        size_t index,
+        bool is_local,
+        bool is_value
+    ) noexcept;
 
     [[nodiscard]] constexpr std::tuple<i32, const Local*>
     resolve_upvalue(Compiler& compiler, const Token& name) noexcept;
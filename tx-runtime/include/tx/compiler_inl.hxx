@@ -7,6 +7,7 @@
 #include "tx/debug.hxx"
 #include "tx/formatting.hxx"
 #include "tx/object.hxx"
+#include "tx/optimizer.hxx"
 #include "tx/scanner.hxx"
 #include "tx/type.hxx"
 #include "tx/utils.hxx"
@@ -39,9 +40,14 @@ inline constexpr std::array opcode_stack_effect_table = {
 
 inline constexpr i32 get_opcode_stack_effect(OpCode opc, size_t operand) {
     using enum OpCode;
-    if (opc == CALL || opc == END_SCOPE || opc == END_SCOPE_LONG) {
+    if (opc == CALL || opc == CALL_CLOSURE || opc == CALL_NATIVE
+        || opc == TAIL_CALL || opc == END_SCOPE || opc == END_SCOPE_LONG) {
         return -gsl::narrow_cast<i32>(operand);
     }
+    if (opc == CALL_GLOBAL || opc == TAIL_CALL_GLOBAL) {
+        // The argument count is the first operand byte, the result is pushed
+        return 1 - gsl::narrow_cast<i32>(operand & 0xffU);
+    }
     return gsl::at(opcode_stack_effect_table, to_underlying(opc));
 }
 
@@ -250,7 +256,7 @@ inline constexpr void Parser::emit_constant(Value value) noexcept {
     emit_var_length_instruction(OpCode::CONSTANT, idx);
 }
 
-inline constexpr void
+inline TX_VALUE_CONSTEXPR void
 Parser::emit_closure(Compiler& compiler, ObjFunction& function) noexcept {
     Expects(function.upvalue_count == compiler.upvalues.size());
     emit_var_length_instruction(
@@ -269,7 +275,9 @@ Parser::emit_closure(Compiler& compiler, ObjFunction& function) noexcept {
             return result == 0 ? 1 : result;
         }(static_cast<usize>(upvalue.index));
         const u8 flags = static_cast<u8>(
-            static_cast<usize>(upvalue.is_local) << 7U | (length & 0b01111111U)
+            (upvalue.is_local ? CLOSURE_OPERAND_IS_LOCAL : 0U)
+            | (upvalue.is_value ? CLOSURE_OPERAND_IS_VALUE : 0U)
+            | (length & CLOSURE_OPERAND_LENGTH_MASK)
         );
         emit_bytes(flags);
         if (length == 1) {
@@ -300,6 +308,58 @@ Parser::emit_closure(Compiler& compiler, ObjFunction& function) noexcept {
     }
 }
 
+inline constexpr void Parser::emit_call(
+    FunctionKind kind,
+    i32 global_idx,
+    size_t arg_count
+) noexcept {
+    using enum OpCode;
+    current_compiler->last_call_offset = current_chunk().code.size();
+    if (global_idx != -1) {
+        // The VM pushes the callee below the arguments, reserve its slot
+        auto& function = *current_compiler->function;
+        function.max_slots = std::max(
+            function.max_slots,
+            size_cast(current_compiler->num_slots) + 1
+        );
+        emit_instruction<2>(CALL_GLOBAL, arg_count | (global_idx << 8U));
+        return;
+    }
+    switch (kind) {
+        case FunctionKind::CLOSURE:
+            emit_instruction<1>(CALL_CLOSURE, arg_count);
+            return;
+        case FunctionKind::NATIVE:
+            // Nothing to gain from a tail call
+            current_compiler->last_call_offset = -1;
+            emit_instruction<1>(CALL_NATIVE, arg_count);
+            return;
+        case FunctionKind::UNKNOWN:
+            emit_instruction<1>(CALL, arg_count);
+            return;
+    }
+    unreachable();
+}
+
+inline constexpr void Parser::emit_return() noexcept {
+    using enum OpCode;
+    const auto offset = current_compiler->last_call_offset;
+    auto& code = current_chunk().code;
+    if (current_compiler->function_type == FunctionType::FUNCTION
+        && offset != -1) {
+        const auto call_opc = code[offset].as_opcode();
+        const auto call_end = offset + 1
+                              + get_byte_count_following_opcode(call_opc);
+        // Last instruction, every path through the call ends with the return
+        if (call_end == code.size()) {
+            const bool is_global = call_opc == CALL_GLOBAL
+                                   || call_opc == TAIL_CALL_GLOBAL;
+            code[offset] = ByteCode(is_global ? TAIL_CALL_GLOBAL : TAIL_CALL);
+        }
+    }
+    emit_instruction(RETURN);
+}
+
 [[nodiscard]] inline constexpr size_t Parser::emit_jump(OpCode instruction
 ) noexcept {
     emit_instruction<2>(instruction, 0xffff);
@@ -349,8 +409,11 @@ inline void Parser::begin_compiler(
 }
 
 [[nodiscard]] inline constexpr ObjFunction& Parser::end_compiler() noexcept {
-    emit_instruction(OpCode::RETURN);
+    emit_return();
     auto& fun = *current_compiler->function;
+    if (parent_vm.get_options().optimize && !had_error) {
+        optimize_chunk(parent_vm, current_chunk());
+    }
     if constexpr (HAS_DEBUG_FEATURES) {
         if (parent_vm.get_options().print_bytecode) {
             if (!had_error) {
@@ -360,6 +423,8 @@ inline void Parser::begin_compiler(
     }
     current_compiler->type_info.destroy(parent_vm);
     current_compiler = current_compiler->enclosing;
+    // No longer a compiler root, keep what was added since the last collection
+    remember_object(parent_vm, fun);
     return fun;
 }
 
@@ -416,7 +481,7 @@ inline constexpr void Parser::patch_jumps_in_innermost_loop() noexcept {
                                   .as<ObjFunction>();
             i += 1 + 1;
             for (auto j = 0; j < fun.upvalue_count; ++j) {
-                auto [is_local, index, len] = read_closure_operand(
+                auto [is_local, is_value, index, len] = read_closure_operand(
                     std::next(current_chunk().code.begin(), i)
                 );
                 i += len;
@@ -438,6 +503,77 @@ inline constexpr void Parser::end_loop() noexcept {
                                            ->enclosing;
 }
 
+// Use the type specialized opcodes when the operand types are known at compile
+// time. Variables of type Float can hold Int values (implicit conversion on
+// assignment), so the _FLOAT versions accept both and convert.
+[[nodiscard]] inline constexpr OpCode get_binary_opcode(
+    Token::Type token_type,
+    const TypeSet& lhs,
+    const TypeSet& rhs
+) noexcept {
+    const bool is_int = lhs.is_int() && rhs.is_int();
+    const bool is_float = !is_int && (lhs.is_int() || lhs.is_float())
+                          && (rhs.is_int() || rhs.is_float());
+    const bool is_string = lhs.is_string() && rhs.is_string();
+    const auto select = [&](OpCode generic, OpCode int_op, OpCode float_op) {
+        if (is_int) { return int_op; }
+        if (is_float) { return float_op; }
+        return generic;
+    };
+    switch (token_type) {
+        using enum Token::Type;
+        case BANG_EQUAL:
+            if (is_int) { return OpCode::NOT_EQUAL_INT; }
+            if (is_string) { return OpCode::NOT_EQUAL_STRING; }
+            return OpCode::NOT_EQUAL;
+        case EQUAL_EQUAL:
+            if (is_int) { return OpCode::EQUAL_INT; }
+            if (is_string) { return OpCode::EQUAL_STRING; }
+            return OpCode::EQUAL;
+        case LEFT_CHEVRON:
+            return select(OpCode::LESS, OpCode::LESS_INT, OpCode::LESS_FLOAT);
+        case LESS_EQUAL:
+            return select(
+                OpCode::LESS_EQUAL,
+                OpCode::LESS_EQUAL_INT,
+                OpCode::LESS_EQUAL_FLOAT
+            );
+        case RIGHT_CHEVRON:
+            return select(
+                OpCode::GREATER,
+                OpCode::GREATER_INT,
+                OpCode::GREATER_FLOAT
+            );
+        case GREATER_EQUAL:
+            return select(
+                OpCode::GREATER_EQUAL,
+                OpCode::GREATER_EQUAL_INT,
+                OpCode::GREATER_EQUAL_FLOAT
+            );
+        case PLUS:
+            return select(OpCode::ADD, OpCode::ADD_INT, OpCode::ADD_FLOAT);
+        case MINUS:
+            return select(
+                OpCode::SUBSTRACT,
+                OpCode::SUBSTRACT_INT,
+                OpCode::SUBSTRACT_FLOAT
+            );
+        case STAR:
+            return select(
+                OpCode::MULTIPLY,
+                OpCode::MULTIPLY_INT,
+                OpCode::MULTIPLY_FLOAT
+            );
+        case SLASH:
+            return select(
+                OpCode::DIVIDE,
+                OpCode::DIVIDE_INT,
+                OpCode::DIVIDE_FLOAT
+            );
+        default: unreachable();
+    }
+}
+
 inline constexpr TypeSet
 Parser::binary(TypeSet lhs, bool /*can_assign*/) noexcept {
     auto token = previous;
@@ -456,20 +592,7 @@ Parser::binary(TypeSet lhs, bool /*can_assign*/) noexcept {
             rhs
         );
     } else {
-        switch (token.type) {
-            using enum Token::Type;
-            case BANG_EQUAL: emit_instruction(OpCode::NOT_EQUAL); break;
-            case EQUAL_EQUAL: emit_instruction(OpCode::EQUAL); break;
-            case LEFT_CHEVRON: emit_instruction(OpCode::LESS); break;
-            case LESS_EQUAL: emit_instruction(OpCode::LESS_EQUAL); break;
-            case RIGHT_CHEVRON: emit_instruction(OpCode::GREATER); break;
-            case GREATER_EQUAL: emit_instruction(OpCode::GREATER_EQUAL); break;
-            case PLUS: emit_instruction(OpCode::ADD); break;
-            case MINUS: emit_instruction(OpCode::SUBSTRACT); break;
-            case STAR: emit_instruction(OpCode::MULTIPLY); break;
-            case SLASH: emit_instruction(OpCode::DIVIDE); break;
-            default: unreachable();
-        }
+        emit_instruction(get_binary_opcode(token.type, lhs, rhs));
     }
     lhs.destroy(parent_vm);
     rhs.destroy(parent_vm);
@@ -495,6 +618,9 @@ Parser::binary(TypeSet lhs, bool /*can_assign*/) noexcept {
 
 inline constexpr TypeSet
 Parser::call(TypeSet lhs, bool /*can_assign*/) noexcept {
+    // Before the arguments, that can be calls themselves
+    const auto kind = std::exchange(callee_kind, FunctionKind::UNKNOWN);
+    const auto global_idx = std::exchange(callee_global_idx, -1);
     auto arg_types = argument_list();
     auto result = type_check_call(parent_vm, lhs, arg_types);
     if (result.is_empty()) {
@@ -505,7 +631,7 @@ Parser::call(TypeSet lhs, bool /*can_assign*/) noexcept {
             arg_types
         );
     }
-    emit_instruction<1>(OpCode::CALL, arg_types.size());
+    emit_call(kind, global_idx, arg_types.size());
     lhs.destroy(parent_vm);
     for (auto& type_set : arg_types) { type_set.destroy(parent_vm); }
     arg_types.destroy(parent_vm);
@@ -567,8 +693,12 @@ Parser::resolve_local(Compiler& compiler, const Token& name) noexcept {
     return -1;
 }
 
-inline constexpr size_t
-Parser::add_upvalue(Compiler& compiler, size_t index, bool is_local) noexcept {
+inline constexpr size_t Parser::add_upvalue(
+    Compiler& compiler,
+    size_t index,
+    bool is_local,
+    bool is_value
+) noexcept {
     auto upvalue_count = compiler.function->upvalue_count;
     for (size_t i = 0; i < upvalue_count; ++i) {
         const auto& upvalue = compiler.upvalues[i];
@@ -580,7 +710,7 @@ Parser::add_upvalue(Compiler& compiler, size_t index, bool is_local) noexcept {
         error(FMT_STRING("Too much closure variables in function."));
         return 0;
     }
-    compiler.upvalues.emplace_back(parent_vm, index, is_local);
+    compiler.upvalues.emplace_back(parent_vm, index, is_local, is_value);
     return compiler.function->upvalue_count++;
 }
 
@@ -591,12 +721,17 @@ Parser::resolve_upvalue(Compiler& compiler, const Token& name) noexcept {
     if (auto local_idx = resolve_local(*compiler.enclosing, name);
         local_idx != -1) {
         auto& local = compiler.enclosing->locals[local_idx];
-        local.is_captured = true;
-        return {add_upvalue(compiler, local_idx, true), &local};
+        // Immutable variables are copied in the closure, only the others
+        // need an upvalue that is closed when they go out of scope
+        const bool is_value = local.is_const && !local.is_defining;
+        if (!is_value) { local.is_captured = true; }
+        return {add_upvalue(compiler, local_idx, true, is_value), &local};
     }
     if (auto [upvalue_idx, var] = resolve_upvalue(*compiler.enclosing, name);
         upvalue_idx != -1) {
-        return {add_upvalue(compiler, upvalue_idx, false), var};
+        const bool is_value =
+            compiler.enclosing->upvalues[upvalue_idx].is_value;
+        return {add_upvalue(compiler, upvalue_idx, false, is_value), var};
     }
     return {-1, nullptr};
 }
@@ -606,6 +741,7 @@ Parser::named_variable(const Token& name, bool can_assign) noexcept {
     OpCode get_op{};
     OpCode set_op{};
     auto is_const = true;
+    auto function_kind = FunctionKind::UNKNOWN;
     const TypeSet* type_set = nullptr;
     i32 idx = resolve_local(*current_compiler, name);
     if (idx != -1) {
@@ -613,19 +749,26 @@ Parser::named_variable(const Token& name, bool can_assign) noexcept {
         set_op = OpCode::SET_LOCAL;
         const auto& local = current_compiler->locals[idx];
         is_const = local.is_const;
+        function_kind = local.function_kind;
         type_set = &local.type_set;
     } else if (auto [uidx, var] = resolve_upvalue(*current_compiler, name);
                uidx != -1) {
         idx = uidx;
-        get_op = OpCode::GET_UPVALUE;
+        get_op = current_compiler->upvalues[uidx].is_value
+                     ? OpCode::GET_UPVALUE_COPY
+                     : OpCode::GET_UPVALUE;
         set_op = OpCode::SET_UPVALUE;
         is_const = var->is_const;
+        function_kind = var->function_kind;
         type_set = &var->type_set;
     } else if (idx = resolve_global(name); idx != -1) {
         get_op = OpCode::GET_GLOBAL;
         set_op = OpCode::SET_GLOBAL;
         const auto& global = parent_vm.global_signatures[idx];
         is_const = global.is_const;
+        if (!parent_vm.options.allow_global_redefinition) {
+            function_kind = global.function_kind;
+        }
         type_set = &global.type_set;
         if (current_compiler->scope_depth == 0) {
             if (!parent_vm.global_signatures[idx].is_defined) {
@@ -651,6 +794,17 @@ Parser::named_variable(const Token& name, bool can_assign) noexcept {
         }
         rhs.destroy(parent_vm);
         emit_var_length_instruction(set_op, idx);
+    } else if (function_kind != FunctionKind::UNKNOWN
+               && check(Token::Type::LEFT_PAREN)) {
+        callee_kind = function_kind;
+        if (get_op == OpCode::GET_GLOBAL
+            && function_kind == FunctionKind::CLOSURE
+            && idx < size_cast(1U << 8U)) {  // NOLINT(*-magic-numbers)
+            // Bound directly by CALL_GLOBAL, nothing to push
+            callee_global_idx = idx;
+        } else {
+            emit_var_length_instruction(get_op, idx);
+        }
     } else {
         emit_var_length_instruction(get_op, idx);
     }
@@ -1138,11 +1292,23 @@ inline void Parser::fn_declaration() noexcept {
     );
     if (match(LEFT_BRACE)) {
         mark_initialized(global_idx);
+        // Can be referenced from its own body, for recursion
+        const bool is_local = current_compiler->scope_depth > 0;
+        if (is_local) {
+            current_compiler->locals.back().is_defining = true;
+            current_compiler->locals.back().function_kind =
+                FunctionKind::CLOSURE;
+        } else {
+            // Calls compiled from now on run after the definition
+            parent_vm.global_signatures[global_idx].function_kind =
+                FunctionKind::CLOSURE;
+        }
         function_body(
             FunctionType::FUNCTION,
             name.lexeme,
             std::move(params_ret)
         );
+        if (is_local) { current_compiler->locals.back().is_defining = false; }
         define_variable(global_idx);
         // NOTE: Do not permit trailing ; after inline fn definition (for now)
         // (void)match(SEMICOLON);
@@ -1357,7 +1523,7 @@ inline constexpr void Parser::return_statement() noexcept {
         expr_type.destroy(parent_vm);
         consume(SEMICOLON, "Expect ';' after return value.");
     }
-    emit_instruction(OpCode::RETURN);
+    emit_return();
 }
 
 inline constexpr void Parser::synchronize() noexcept {
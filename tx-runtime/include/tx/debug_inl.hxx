@@ -80,12 +80,13 @@ closure_instruction(const ByteCode* ptr, const Chunk& chunk) noexcept {
     const auto& function =
         chunk.constants[constant_idx].as_object().template as<ObjFunction>();
     for (size_t i = 0; i < function.upvalue_count; ++i) {
-        auto [is_local, index, len] = read_closure_operand(ptr);
+        auto [is_local, is_value, index, len] = read_closure_operand(ptr);
         fmt::print(
-            FMT_STRING("{:04d}      |                       {:s} {:d}\n"),
+            FMT_STRING("{:04d}      |                       {:s} {:d}{:s}\n"),
             size_cast(std::distance(chunk.code.cbegin(), ptr)),
             is_local ? "local" : "upvalue",
-            index
+            index,
+            is_value ? " (copy)" : ""
         );
         std::advance(ptr, len);
     }
@@ -103,6 +104,50 @@ template <u32 N>
     return std::next(ptr, 1 + N);
 }
 
+[[nodiscard]] inline const ByteCode* local_local_instruction(const ByteCode* ptr
+) noexcept {
+    const OpCode instruction = ptr->as_opcode();
+    const auto* name = get_opcode_name(instruction);
+    assert(2 == get_byte_count_following_opcode(instruction));
+    fmt::print(
+        FMT_STRING("{:18s} {:4d} {:4d}\n"),
+        name,
+        read_multibyte_operand<1>(std::next(ptr, 1)),
+        read_multibyte_operand<1>(std::next(ptr, 2))
+    );
+    return std::next(ptr, 1 + 2);
+}
+
+[[nodiscard]] inline const ByteCode* call_global_instruction(const ByteCode* ptr
+) noexcept {
+    const OpCode instruction = ptr->as_opcode();
+    const auto* name = get_opcode_name(instruction);
+    assert(2 == get_byte_count_following_opcode(instruction));
+    fmt::print(
+        FMT_STRING("{:18s} {:4d} global {:d}\n"),
+        name,
+        read_multibyte_operand<1>(std::next(ptr, 1)),
+        read_multibyte_operand<1>(std::next(ptr, 2))
+    );
+    return std::next(ptr, 1 + 2);
+}
+
+[[nodiscard]] inline const ByteCode*
+local_constant_instruction(const ByteCode* ptr, const Chunk& chunk) noexcept {
+    const OpCode instruction = ptr->as_opcode();
+    const auto* name = get_opcode_name(instruction);
+    assert(2 == get_byte_count_following_opcode(instruction));
+    const auto constant_idx = read_multibyte_operand<1>(std::next(ptr, 2));
+    fmt::print(
+        FMT_STRING("{:18s} {:4d} {:4d} '{}'\n"),
+        name,
+        read_multibyte_operand<1>(std::next(ptr, 1)),
+        constant_idx,
+        chunk.constants[size_cast(constant_idx)]
+    );
+    return std::next(ptr, 1 + 2);
+}
+
 [[nodiscard]] inline const ByteCode*
 jump_instruction(const ByteCode* ptr, size_t sign, size_t offset) {
     assert(sign == -1 || sign == 1);
@@ -156,6 +201,26 @@ disassemble_instruction(const Chunk& chunk, const ByteCode* ptr) noexcept {
         case SUBSTRACT:
         case MULTIPLY:
         case DIVIDE:
+        case EQUAL_INT:
+        case NOT_EQUAL_INT:
+        case GREATER_INT:
+        case GREATER_EQUAL_INT:
+        case LESS_INT:
+        case LESS_EQUAL_INT:
+        case ADD_INT:
+        case SUBSTRACT_INT:
+        case MULTIPLY_INT:
+        case DIVIDE_INT:
+        case GREATER_FLOAT:
+        case GREATER_EQUAL_FLOAT:
+        case LESS_FLOAT:
+        case LESS_EQUAL_FLOAT:
+        case ADD_FLOAT:
+        case SUBSTRACT_FLOAT:
+        case MULTIPLY_FLOAT:
+        case DIVIDE_FLOAT:
+        case EQUAL_STRING:
+        case NOT_EQUAL_STRING:
         case NOT:
         case NEGATE:
         case RETURN:
@@ -169,8 +234,14 @@ disassemble_instruction(const Chunk& chunk, const ByteCode* ptr) noexcept {
         case SET_LOCAL:
         case GET_UPVALUE:
         case SET_UPVALUE:
+        case GET_UPVALUE_COPY:
         case CALL:
+        case CALL_CLOSURE:
+        case CALL_NATIVE:
+        case TAIL_CALL:
         case END_SCOPE: return var_length_instruction<1>(ptr);
+        case CALL_GLOBAL:
+        case TAIL_CALL_GLOBAL: return call_global_instruction(ptr);
         case GET_GLOBAL_LONG:
         case SET_GLOBAL_LONG:
         case DEFINE_GLOBAL_LONG:
@@ -178,18 +249,24 @@ disassemble_instruction(const Chunk& chunk, const ByteCode* ptr) noexcept {
         case SET_LOCAL_LONG:
         case GET_UPVALUE_LONG:
         case SET_UPVALUE_LONG:
+        case GET_UPVALUE_COPY_LONG:
         case END_SCOPE_LONG: return var_length_instruction<3>(ptr);
         case JUMP:
         case JUMP_IF_FALSE: return jump_instruction(ptr, 1, offset);
         case LOOP: return jump_instruction(ptr, -1, offset);
         case CLOSURE: return closure_instruction<1>(ptr, chunk);
         case CLOSURE_LONG: return closure_instruction<3>(ptr, chunk);
+        case GET_LOCAL_GET_LOCAL: return local_local_instruction(ptr);
+        case GET_LOCAL_CONSTANT_ADD_INT:
+        case GET_LOCAL_CONSTANT_SUBSTRACT_INT:
+            return local_constant_instruction(ptr, chunk);
+        case LESS_INT_JUMP_IF_FALSE: return jump_instruction(ptr, 1, offset);
     }
     unreachable();
 }
 
 inline void print_token(const Token& token) noexcept {
-    static i32 line = -1;
+    static thread_local i32 line = -1;
     if (token.line != line) {
         fmt::print(FMT_STRING("{:4d} "), token.line);
         line = gsl::narrow_cast<i32>(token.line);
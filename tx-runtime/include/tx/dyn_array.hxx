@@ -93,7 +93,7 @@ class DynArray {
     constexpr void destroy(VM& tvm) noexcept {
         clear();
         if (data_ptr != nullptr) {
-            free_array(tvm, data_ptr, capacity_);
+            free_array<T, TRIGGER_GC>(tvm, data_ptr, capacity_);
             data_ptr = nullptr;  // NOLINT
             capacity_ = 0;
         }
@@ -147,6 +147,14 @@ class DynArray {
 
     [[nodiscard]] constexpr SizeT size() const noexcept { return count; }
 
+    // For the native code of the JIT, that pushes and pops in place and
+    // reads the data of arrays that may be reallocated between its runs
+    [[nodiscard]] constexpr SizeT* size_ptr() noexcept { return &count; }
+
+    [[nodiscard]] constexpr T* const* data_ptr_ptr() const noexcept {
+        return &data_ptr;
+    }
+
     [[nodiscard]] constexpr SizeT capacity() const noexcept {
         return capacity_;
     }
@@ -14,7 +14,7 @@ struct formatter<tx::Value> : formatter<string_view> {
     template <typename FormatContext>
     constexpr auto format(const tx::Value& value, FormatContext& ctx)
         const noexcept {
-        switch (value.type) {
+        switch (value.get_type()) {
             using enum tx::Value::Type;
             case NONE: return format_to(ctx.out(), "<none>");
             case NIL: return format_to(ctx.out(), "nil");
@@ -69,6 +69,8 @@ struct formatter<tx::Obj> : formatter<string_view> {
                 return format_to(ctx.out(), "{:s}", std::string_view(str));
             }
             case UPVALUE: return format_to(ctx.out(), "<upvalue>");
+            case INT:
+                return format_to(ctx.out(), "{:d}", obj.as<tx::ObjInt>().value);
         }
         tx::unreachable();
     }
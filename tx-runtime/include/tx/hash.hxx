@@ -60,6 +60,7 @@ struct Hash<Obj> {
         switch (obj.type) {
             using enum Obj::ObjType;
             case STRING: return obj.as<ObjString>().hash;
+            case INT: return Hash<int_t>()(obj.as<ObjInt>().value);
             case CLOSURE:
             case FUNCTION:
             case NATIVE:
@@ -76,7 +77,7 @@ struct Hash<Obj> {
 template <>
 struct Hash<Value> {
     constexpr u32 operator()(Value const& val) const noexcept {
-        switch (val.type) {
+        switch (val.get_type()) {
             using enum Value::Type;
             case NONE: unreachable();
             case NIL: return HASH_NIL;
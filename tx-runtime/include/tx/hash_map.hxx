@@ -25,7 +25,8 @@ template <
     T TOMBSTONE_VALUE,
     typename Hash = Hash<Key>,
     typename KeyEqual = std::equal_to<Key>,
-    typename SizeT = size_t>
+    typename SizeT = size_t,
+    bool TRIGGER_GC = true>
 class HashMap {
     static_assert(EMPTY_VALUE != TOMBSTONE_VALUE);
 
@@ -173,9 +174,10 @@ class HashMap {
     }
 
     constexpr void destroy(VM& tvm) noexcept {
+        const auto old_capacity = capacity;
         clear();
         if (data_ptr != nullptr) {
-            free_array(tvm, data_ptr, capacity);
+            free_array<Entry, TRIGGER_GC>(tvm, data_ptr, old_capacity);
             data_ptr = nullptr;
         }
     }
@@ -324,7 +326,7 @@ class HashMap {
         assert(is_power_of_2(new_cap));
         auto* old_ptr = data_ptr;
         auto old_capacity = capacity;
-        data_ptr = allocate<Entry>(tvm, new_cap);
+        data_ptr = allocate<Entry, TRIGGER_GC>(tvm, new_cap);
         std::uninitialized_fill_n(
             data_ptr,
             new_cap,
@@ -342,7 +344,7 @@ class HashMap {
         }
         if (old_ptr != nullptr) {
             std::destroy_n(old_ptr, old_capacity);
-            free_array<Entry>(tvm, old_ptr, old_capacity);
+            free_array<Entry, TRIGGER_GC>(tvm, old_ptr, old_capacity);
         }
     }
 };
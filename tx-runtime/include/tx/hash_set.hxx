@@ -5,28 +5,43 @@
 
 namespace tx {
 
+// Map is the backend, HashMap or SwissMap
 template <
     typename T,
     T EMPTY_VALUE,
     typename Hash = Hash<T>,
-    typename Equal = std::equal_to<T> >
+    typename Equal = std::equal_to<T>,
+    template <
+        typename Key,
+        typename V,
+        Key,
+        V,
+        V,
+        typename,
+        typename,
+        typename,
+        bool> class Map = HashMap>
 class HashSet
-        : public HashMap<
+        : public Map<
               T,
               Value,
               EMPTY_VALUE,
               Value{val_none},
               Value{val_nil},
               Hash,
-              Equal> {
-    using Base = HashMap<
+              Equal,
+              size_t,
+              true> {
+    using Base = Map<
         T,
         Value,
         EMPTY_VALUE,
         Value{val_none},
         Value{val_nil},
         Hash,
-        Equal>;
+        Equal,
+        size_t,
+        true>;
 
   public:
     constexpr bool add(VM& tvm, T val) noexcept {
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "tx/common.hxx"
+
+#include <cstdio>
+#include <span>
+#include <string_view>
+
+namespace tx {
+
+class VM;
+struct ObjFunction;
+
+// Precompiled bytecode image (.txc)
+//
+// An image contains the global signatures and the bytecode, line table and
+// constants of a compiled script and of all its nested functions. Loading an
+// image skips scanning, parsing and type checking. Images are tied to the
+// exact version of Tx that wrote them and are rejected otherwise. The
+// bytecode itself is trusted and not validated.
+
+inline constexpr std::string_view IMAGE_FILE_EXTENSION = ".txc";
+
+// Write the compiled script function to file
+[[nodiscard]] bool
+write_image(VM& tvm, const ObjFunction& script, std::FILE* file) noexcept;
+
+// Load the script function from an image in memory. Strings and file paths
+// point directly into the image memory, which must outlive the VM.
+[[nodiscard]] ObjFunction* read_image(
+    VM& tvm,
+    std::string_view image_path,
+    std::span<const char> image
+) noexcept;
+
+}  // namespace tx
@@ -0,0 +1,425 @@
+#pragma once
+
+#include "tx/image.hxx"
+//
+#include "tx/chunk.hxx"
+#include "tx/common.hxx"
+#include "tx/compiler.hxx"
+#include "tx/dyn_array.hxx"
+#include "tx/memory.hxx"
+#include "tx/object.hxx"
+#include "tx/type.hxx"
+#include "tx/value.hxx"
+#include "tx/vm.hxx"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <limits>
+
+namespace tx {
+
+inline constexpr std::array<char, 4> IMAGE_MAGIC{'T', 'X', 'C', '\0'};
+inline constexpr u32 IMAGE_FORMAT_VERSION = 3;
+inline constexpr size_t IMAGE_MAX_DEPTH = 256;
+
+enum class ImageTag : u8 {
+    NIL,
+    BOOL,
+    INT,
+    FLOAT,
+    CHAR,
+    STRING,
+    FUNCTION,
+};
+
+class ImageWriter {
+    VM& tvm;
+    std::FILE* file;
+    bool had_error = false;
+
+  public:
+    ImageWriter(VM& tvm_, std::FILE* file_) noexcept
+            : tvm(tvm_)
+            , file(file_) {}
+
+    [[nodiscard]] bool write(const ObjFunction& script) noexcept {
+        write_header();
+        write_globals();
+        write_function(script);
+        return !had_error;
+    }
+
+  private:
+    void write_bytes(const void* data, size_t size) noexcept {
+        if (had_error || size == 0) { return; }
+        const auto count = static_cast<std::size_t>(size);
+        if (std::fwrite(data, 1, count, file) != count) { had_error = true; }
+    }
+
+    template <typename T>
+    void write(T value) noexcept {
+        write_bytes(&value, sizeof(T));
+    }
+
+    void write_count(size_t count) noexcept {
+        write(static_cast<u64>(count));
+    }
+
+    void write_string(std::string_view str) noexcept {
+        write_count(size_cast(str.size()));
+        write_bytes(str.data(), size_cast(str.size()));
+    }
+
+    void write_header() noexcept {
+        write_bytes(IMAGE_MAGIC.data(), size_cast(IMAGE_MAGIC.size()));
+        write(IMAGE_FORMAT_VERSION);
+        write(static_cast<u32>(opcode_length_table.size()));
+        write_string(VERSION);
+        write_string(GIT_SHA);
+    }
+
+    void write_type_set(const TypeSet& type_set) noexcept {
+        write_count(type_set.types.size());
+        for (const auto& type_info : type_set.types) {
+            write(static_cast<u8>(to_underlying(type_info.type)));
+            if (!type_info.is<TypeInfo::Type::FUNCTION>()) { continue; }
+            const auto& fun = type_info.as_function();
+            write_count(fun.parameter_types.size());
+            for (const auto& param : fun.parameter_types) {
+                write_type_set(param);
+            }
+            write_type_set(fun.return_type);
+        }
+    }
+
+    void write_globals() noexcept {
+        const auto count = tvm.global_values.size();
+        // Does not trigger the GC, the script function is not rooted
+        DynArray<Value, size_t, false> names(tvm, count, Value{val_nil});
+        for (const auto& entry : tvm.global_indices) {
+            names[size_cast(entry.second.as_int())] = entry.first;
+        }
+        write_count(count);
+        for (size_t i = 0; i < count; ++i) {
+            const auto& signature = tvm.global_signatures[i];
+            write_string(names[i].as_object().as<ObjString>());
+            write(static_cast<u8>(signature.is_defined));
+            write(static_cast<u8>(signature.is_const));
+            write_type_set(signature.type_set);
+        }
+        names.destroy(tvm);
+    }
+
+    void write_constant(const Value& value) noexcept {
+        if (value.is_nil()) {
+            write(ImageTag::NIL);
+        } else if (value.is_bool()) {
+            write(ImageTag::BOOL);
+            write(static_cast<u8>(value.as_bool()));
+        } else if (value.is_int()) {
+            write(ImageTag::INT);
+            write(value.as_int());
+        } else if (value.is_float()) {
+            write(ImageTag::FLOAT);
+            write(value.as_float());
+        } else if (value.is_char()) {
+            write(ImageTag::CHAR);
+            write(value.as_char());
+        } else if (value.is_object() && value.as_object().is_string()) {
+            write(ImageTag::STRING);
+            write_string(value.as_object().as<ObjString>());
+        } else if (value.is_object() && value.as_object().is_function()) {
+            write(ImageTag::FUNCTION);
+            write_function(value.as_object().as<ObjFunction>());
+        } else {
+            unreachable();
+        }
+    }
+
+    // NOLINTNEXTLINE(misc-no-recursion)
+    void write_function(const ObjFunction& function) noexcept {
+        write_count(function.arity);
+        write_count(function.upvalue_count);
+        write_count(function.max_slots);
+        write(static_cast<u8>(function.name != nullptr));
+        if (function.name != nullptr) { write_string(*function.name); }
+        write_string(function.module_file_path);
+        const auto& chunk = function.chunk;
+        static_assert(sizeof(ByteCode) == 1);
+        write_count(chunk.code.size());
+        write_bytes(chunk.code.data(), chunk.code.size());
+        write_count(chunk.lines.size());
+        for (const auto& line_start : chunk.lines) {
+            write_count(line_start.offset);
+            write_count(line_start.line);
+        }
+        write_count(chunk.constants.size());
+        for (const auto& constant : chunk.constants) {
+            write_constant(constant);
+        }
+    }
+};
+
+class ImageReader {
+    VM& tvm;
+    std::string_view image_path;
+    std::span<const char> image;
+    std::size_t position = 0;
+    bool had_error = false;
+
+  public:
+    ImageReader(
+        VM& tvm_,
+        std::string_view image_path_,
+        std::span<const char> image_
+    ) noexcept
+            : tvm(tvm_)
+            , image_path(image_path_)
+            , image(image_) {}
+
+    [[nodiscard]] ObjFunction* read() noexcept {
+        if (!read_header()) { return nullptr; }
+        read_globals();
+        auto* function = read_function(0);
+        if (!had_error && position != image.size()) {
+            error("Unexpected data at end of file.");
+        }
+        return had_error ? nullptr : function;
+    }
+
+  private:
+    void error(std::string_view message) noexcept {
+        if (had_error) { return; }
+        had_error = true;
+        fmt::print(
+            stderr,
+            FMT_STRING("Invalid image file \"{:s}\": {:s}\n"),
+            image_path,
+            message
+        );
+    }
+
+    [[nodiscard]] std::span<const char> read_bytes(std::size_t size) noexcept {
+        if (had_error) { return {}; }
+        if (image.size() - position < size) {
+            error("Unexpected end of file.");
+            return {};
+        }
+        auto result = image.subspan(position, size);
+        position += size;
+        return result;
+    }
+
+    template <typename T>
+    [[nodiscard]] T read() noexcept {
+        T result{};
+        const auto bytes = read_bytes(sizeof(T));
+        if (!bytes.empty()) { std::memcpy(&result, bytes.data(), sizeof(T)); }
+        return result;
+    }
+
+    [[nodiscard]] size_t read_size() noexcept { return size_cast(read<u64>()); }
+
+    // Counts are bounded by the remaining size, as each element takes at least
+    // one byte, to avoid huge allocations on corrupted files
+    [[nodiscard]] size_t read_count() noexcept {
+        const auto count = read<u64>();
+        if (count > image.size() - position) {
+            error("Invalid count.");
+            return 0;
+        }
+        return size_cast(count);
+    }
+
+    [[nodiscard]] std::string_view read_string() noexcept {
+        const auto bytes = read_bytes(static_cast<std::size_t>(read_count()));
+        return {bytes.data(), bytes.size()};
+    }
+
+    [[nodiscard]] bool read_header() noexcept {
+        const auto magic = read_bytes(IMAGE_MAGIC.size());
+        if (had_error || !std::ranges::equal(magic, IMAGE_MAGIC)) {
+            error("Not a Tx image.");
+            return false;
+        }
+        const auto format_version = read<u32>();
+        const auto opcode_count = read<u32>();
+        const auto version = read_string();
+        const auto git_sha = read_string();
+        if (had_error) { return false; }
+        if (format_version != IMAGE_FORMAT_VERSION
+            || opcode_count != opcode_length_table.size() || version != VERSION
+            || git_sha != GIT_SHA) {
+            error("Compiled by a different version of Tx, recompile it.");
+            return false;
+        }
+        return true;
+    }
+
+    // NOLINTNEXTLINE(misc-no-recursion)
+    [[nodiscard]] TypeSet read_type_set(size_t depth) noexcept {
+        TypeSet result;
+        if (depth > IMAGE_MAX_DEPTH) {
+            error("Types nested too deeply.");
+            return result;
+        }
+        const auto count = read_count();
+        for (size_t i = 0; i < count && !had_error; ++i) {
+            const auto kind = read<u8>();
+            if (kind > to_underlying(TypeInfo::Type::STRING)) {
+                error("Invalid type.");
+                break;
+            }
+            const auto type = static_cast<TypeInfo::Type>(kind);
+            if (type != TypeInfo::Type::FUNCTION) {
+                result.add(tvm, TypeInfo{type});
+                continue;
+            }
+            const auto param_count = read_count();
+            TypeSetArray params;
+            params.reserve(tvm, param_count);
+            for (size_t j = 0; j < param_count && !had_error; ++j) {
+                params.push_back_unsafe(read_type_set(depth + 1));
+            }
+            auto return_type = read_type_set(depth + 1);
+            result.add(
+                tvm,
+                TypeInfo{TypeInfoFunction{
+                    .parameter_types = std::move(params),
+                    .return_type = std::move(return_type)}}
+            );
+        }
+        return result;
+    }
+
+    void read_globals() noexcept {
+        const auto count = read_count();
+        const auto existing_count = tvm.global_values.size();
+        for (size_t i = 0; i < count && !had_error; ++i) {
+            const auto name = read_string();
+            Global signature{
+                .is_defined = read<u8>() != 0,
+                .is_const = read<u8>() != 0,
+                .type_set = read_type_set(0)};
+            if (had_error || i < existing_count) {
+                // Natives are already defined by the VM, check they match
+                if (!had_error && tvm.get_global_name(i) != name) {
+                    error("Unknown global, recompile it.");
+                }
+                signature.destroy(tvm);
+                continue;
+            }
+            // make_string() also needs one slot
+            tvm.ensure_stack_space(tvm.stack.size() + 2);
+            tvm.push(Value{make_string(tvm, false, name)});
+            (void)tvm.add_global(
+                tvm.peek(0),
+                std::move(signature),
+                Value{val_none}
+            );
+            tvm.pop();
+        }
+    }
+
+    // NOLINTNEXTLINE(misc-no-recursion)
+    [[nodiscard]] Value read_constant(size_t depth) noexcept {
+        const auto tag = read<ImageTag>();
+        switch (tag) {
+            using enum ImageTag;
+            case NIL: return Value{val_nil};
+            case BOOL: return Value{read<u8>() != 0};
+            case INT: return make_int(tvm, read<int_t>());
+            case FLOAT: return Value{read<float_t>()};
+            case CHAR: return Value{read<char32_t>()};
+            case STRING: {
+                const auto str = read_string();
+                if (had_error) { break; }
+                return Value{make_string(tvm, false, str)};
+            }
+            case FUNCTION: {
+                auto* function = read_function(depth + 1);
+                if (function == nullptr) { break; }
+                return Value{function};
+            }
+            default: error("Invalid constant."); break;
+        }
+        return Value{val_nil};
+    }
+
+    // Functions are kept on the stack while being loaded so that the GC can
+    // see them
+    // NOLINTNEXTLINE(misc-no-recursion)
+    [[nodiscard]] ObjFunction* read_function(size_t depth) noexcept {
+        if (depth > IMAGE_MAX_DEPTH) {
+            error("Functions nested too deeply.");
+            return nullptr;
+        }
+        const auto arity = read_size();
+        const auto upvalue_count = read_size();
+        const auto max_slots = read_size();
+        const bool has_name = read<u8>() != 0;
+        const auto name = has_name ? read_string() : std::string_view{};
+        const auto module_file_path = read_string();
+        if (had_error) { return nullptr; }
+        // One more slot for make_string()
+        tvm.ensure_stack_space(tvm.stack.size() + 2);
+        auto* function = allocate_object<ObjFunction>(
+            tvm,
+            max_slots,
+            module_file_path
+        );
+        tvm.push(Value{function});
+        function->arity = arity;
+        function->upvalue_count = upvalue_count;
+        if (has_name) {
+            function->name = make_string(tvm, false, name);
+            write_barrier(tvm, *function, function->name);
+        }
+        auto& chunk = function->chunk;
+        const auto code = read_bytes(static_cast<std::size_t>(read_count()));
+        chunk.code.resize(tvm, size_cast(code.size()), ByteCode{OpCode::END});
+        if (!code.empty()) {
+            std::memcpy(chunk.code.data(), code.data(), code.size());
+        }
+        const auto line_count = read_count();
+        chunk.lines.reserve(tvm, line_count);
+        for (size_t i = 0; i < line_count && !had_error; ++i) {
+            const auto offset = read_size();
+            const auto line = read_size();
+            chunk.lines.emplace_back(tvm, offset, line);
+        }
+        if (!chunk.code.empty() && chunk.lines.empty()) {
+            error("Missing line information.");
+        }
+        const auto constant_count = read_count();
+        chunk.constants.reserve(tvm, constant_count);
+        for (size_t i = 0; i < constant_count && !had_error; ++i) {
+            const auto constant = read_constant(depth);
+            write_barrier(tvm, *function, constant);
+            // Capacity is reserved, adding the constant cannot trigger the GC
+            chunk.constants.push_back_unsafe(constant);
+        }
+        tvm.pop();
+        return had_error ? nullptr : function;
+    }
+};
+
+inline bool
+write_image(VM& tvm, const ObjFunction& script, std::FILE* file) noexcept {
+    ImageWriter writer(tvm, file);
+    return writer.write(script);
+}
+
+inline ObjFunction* read_image(
+    VM& tvm,
+    std::string_view image_path,
+    std::span<const char> image
+) noexcept {
+    ImageReader reader(tvm, image_path, image);
+    return reader.read();
+}
+
+}  // namespace tx
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "tx/common.hxx"
+
+namespace tx {
+
+class VM;
+struct CallFrame;
+struct ObjFunction;
+
+// Native code of a hot function, only generated in builds with a JIT (see
+// TX_HAS_JIT in common.hxx).
+//
+// Each instruction of the bytecode is translated into a template of x86-64
+// machine code, with its operands baked in, and the templates are stitched
+// together with native jumps. Globals, upvalues and the generic operations
+// call back into the VM; calls, returns and closures leave the native code
+// and are executed by the interpreter, that enters the native code again at
+// the instruction that follows. The native code also leaves before any
+// instruction whose operands it does not handle, so the interpreter executes
+// it and reports the runtime errors.
+struct JitCode;
+
+// Translate the function, nullptr when the code could not be mapped
+[[nodiscard]] JitCode*
+jit_compile(VM& tvm, const ObjFunction& function) noexcept;
+
+// Run the function of the frame, the top frame, from its current instruction
+// until the first instruction left to the interpreter
+void jit_run(VM& tvm, const JitCode& code, CallFrame& frame) noexcept;
+
+void free_jit_code(JitCode* code) noexcept;
+
+}  // namespace tx
@@ -0,0 +1,1250 @@
+#pragma once
+
+#include "tx/jit.hxx"
+//
+#include "tx/chunk.hxx"
+#include "tx/common.hxx"
+#include "tx/dyn_array.hxx"
+#include "tx/object.hxx"
+#include "tx/utils.hxx"
+#include "tx/value.hxx"
+#include "tx/vm.hxx"
+
+#ifdef TX_HAS_JIT
+#include <sys/mman.h>
+
+#include <bit>
+#include <cstddef>
+#include <cstring>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#endif
+
+namespace tx {
+
+#ifdef TX_HAS_JIT
+
+// One mapping holds the header, the offset in the code of each instruction,
+// indexed by its offset in the bytecode, and the code
+struct JitCode {
+    size_t map_size;
+    size_t code_offset;
+    size_t entry_count;
+
+    [[nodiscard]] const u32* entries() const noexcept {
+        // NOLINTNEXTLINE(*-reinterpret-cast)
+        return reinterpret_cast<const u32*>(std::next(this));
+    }
+
+    [[nodiscard]] const u8* code() const noexcept {
+        // NOLINTNEXTLINE(*-reinterpret-cast)
+        return std::next(reinterpret_cast<const u8*>(this), code_offset);
+    }
+};
+
+// clang-format off
+enum class Reg : u8 {
+    RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+    R8, R9, R10, R11, R12, R13, R14, R15,
+};
+// clang-format on
+
+enum class Xmm : u8 { XMM0, XMM1 };
+
+// Condition codes of jcc and setcc
+enum class Cond : u8 {
+    B = 0x2,
+    AE = 0x3,
+    E = 0x4,
+    NE = 0x5,
+    BE = 0x6,
+    A = 0x7,
+    L = 0xc,
+    GE = 0xd,
+    LE = 0xe,
+    G = 0xf,
+};
+
+// [base + disp]
+struct Mem {
+    Reg base;
+    i32 disp;
+};
+
+// Encoder of the few x86-64 instructions used by the templates
+class X86Assembler {
+    VM& tvm;
+    DynArray<u8, size_t, false> buffer;
+
+  public:
+    explicit X86Assembler(VM& tvm_) noexcept
+            : tvm(tvm_) {}
+    X86Assembler(const X86Assembler& other) = delete;
+    X86Assembler(X86Assembler&& other) = delete;
+
+    ~X86Assembler() noexcept { buffer.destroy(tvm); }
+
+    X86Assembler& operator=(const X86Assembler& rhs) = delete;
+    X86Assembler& operator=(X86Assembler&& rhs) = delete;
+
+    [[nodiscard]] size_t position() const noexcept { return buffer.size(); }
+    [[nodiscard]] const u8* data() const noexcept { return buffer.data(); }
+
+    // Jumps return the position of their displacement, to bind to a target
+    [[nodiscard]] size_t jmp() noexcept {
+        emit_u8(0xe9);
+        return emit_displacement();
+    }
+
+    [[nodiscard]] size_t jcc(Cond cond) noexcept {
+        emit_u8(0x0f);
+        emit_u8(0x80U | to_underlying(cond));
+        return emit_displacement();
+    }
+
+    void bind(size_t displacement) noexcept {
+        bind_to(displacement, position());
+    }
+
+    void bind_to(size_t displacement, size_t target) noexcept {
+        const auto rel = static_cast<u32>(
+            static_cast<i32>(target - (displacement + 4))
+        );
+        for (size_t i = 0; i < 4; ++i) {
+            buffer[displacement + i] = static_cast<u8>(rel >> (i * 8));
+        }
+    }
+
+    void mov(Reg dst, Mem src) noexcept { op_mem(0, true, {0x8b}, dst, src); }
+    void mov(Mem dst, Reg src) noexcept { op_mem(0, true, {0x89}, src, dst); }
+
+    void mov(Reg dst, Reg src) noexcept {
+        rex(true, to_underlying(src), to_underlying(dst));
+        emit_u8(0x89);
+        modrm_reg(to_underlying(src), to_underlying(dst));
+    }
+
+    void mov(Reg dst, u64 imm) noexcept {
+        rex(true, 0, to_underlying(dst));
+        emit_u8(0xb8U + (to_underlying(dst) & 7U));
+        emit_u64(imm);
+    }
+
+    // 32 bits store, for the type of tagged values
+    void mov32(Mem dst, u32 imm) noexcept {
+        op_mem(0, false, {0xc7}, 0, dst);
+        emit_u32(imm);
+    }
+
+    void add(Reg dst, Mem src) noexcept { op_mem(0, true, {0x03}, dst, src); }
+    void sub(Reg dst, Mem src) noexcept { op_mem(0, true, {0x2b}, dst, src); }
+    void cmp(Reg lhs, Mem rhs) noexcept { op_mem(0, true, {0x3b}, lhs, rhs); }
+
+    void imul(Reg dst, Mem src) noexcept {
+        op_mem(0, true, {0x0f, 0xaf}, dst, src);
+    }
+
+    void add(Reg dst, Reg src) noexcept { op_reg(0x01, dst, src); }
+    void sub(Reg dst, Reg src) noexcept { op_reg(0x29, dst, src); }
+    void cmp(Reg lhs, Reg rhs) noexcept { op_reg(0x39, lhs, rhs); }
+
+    void add(Reg dst, i32 imm) noexcept { op_imm(0, dst, imm); }
+    void sub(Reg dst, i32 imm) noexcept { op_imm(5, dst, imm); }
+    void cmp(Reg lhs, i32 imm) noexcept { op_imm(7, lhs, imm); }
+
+    void cmp32(Mem lhs, u32 imm) noexcept {
+        op_mem(0, false, {0x81}, 7, lhs);
+        emit_u32(imm);
+    }
+
+    void cmp8(Mem lhs, u8 imm) noexcept {
+        op_mem(0, false, {0x80}, 7, lhs);
+        emit_u8(imm);
+    }
+
+    void shl(Reg dst, u8 count) noexcept { shift(4, dst, count); }
+    void shr(Reg dst, u8 count) noexcept { shift(5, dst, count); }
+    void sar(Reg dst, u8 count) noexcept { shift(7, dst, count); }
+
+    // setcc al, then movzx eax, al
+    void setcc_eax(Cond cond) noexcept {
+        emit_u8(0x0f);
+        emit_u8(0x90U | to_underlying(cond));
+        emit_u8(0xc0);
+        emit_u8(0x0f);
+        emit_u8(0xb6);
+        emit_u8(0xc0);
+    }
+
+    // test al, al
+    void test_al() noexcept {
+        emit_u8(0x84);
+        emit_u8(0xc0);
+    }
+
+    void call(Reg target) noexcept {
+        rex(false, 0, to_underlying(target));
+        emit_u8(0xff);
+        modrm_reg(2, to_underlying(target));
+    }
+
+    void jmp(Reg target) noexcept {
+        rex(false, 0, to_underlying(target));
+        emit_u8(0xff);
+        modrm_reg(4, to_underlying(target));
+    }
+
+    void push(Reg reg) noexcept {
+        rex(false, 0, to_underlying(reg));
+        emit_u8(0x50U + (to_underlying(reg) & 7U));
+    }
+
+    void pop(Reg reg) noexcept {
+        rex(false, 0, to_underlying(reg));
+        emit_u8(0x58U + (to_underlying(reg) & 7U));
+    }
+
+    void ret() noexcept { emit_u8(0xc3); }
+
+    void movups(Xmm dst, Mem src) noexcept {
+        op_mem(0, false, {0x0f, 0x10}, dst, src);
+    }
+
+    void movups(Mem dst, Xmm src) noexcept {
+        op_mem(0, false, {0x0f, 0x11}, src, dst);
+    }
+
+    void movsd(Xmm dst, Mem src) noexcept {
+        op_mem(0xf2, false, {0x0f, 0x10}, dst, src);
+    }
+
+    void movsd(Mem dst, Xmm src) noexcept {
+        op_mem(0xf2, false, {0x0f, 0x11}, src, dst);
+    }
+
+    // From a 64 bits integer
+    void cvtsi2sd(Xmm dst, Mem src) noexcept {
+        op_mem(0xf2, true, {0x0f, 0x2a}, dst, src);
+    }
+
+    void addsd(Xmm dst, Xmm src) noexcept { op_sse(0xf2, 0x58, dst, src); }
+    void mulsd(Xmm dst, Xmm src) noexcept { op_sse(0xf2, 0x59, dst, src); }
+    void subsd(Xmm dst, Xmm src) noexcept { op_sse(0xf2, 0x5c, dst, src); }
+    void divsd(Xmm dst, Xmm src) noexcept { op_sse(0xf2, 0x5e, dst, src); }
+    void ucomisd(Xmm lhs, Xmm rhs) noexcept { op_sse(0x66, 0x2e, lhs, rhs); }
+
+  private:
+    void emit_u8(u8 byte) noexcept { buffer.push_back(tvm, byte); }
+
+    void emit_u32(u32 val) noexcept {
+        for (u32 i = 0; i < 4; ++i) {
+            emit_u8(static_cast<u8>(val >> (i * 8)));
+        }
+    }
+
+    void emit_u64(u64 val) noexcept {
+        for (u32 i = 0; i < 8; ++i) {
+            emit_u8(static_cast<u8>(val >> (i * 8)));
+        }
+    }
+
+    [[nodiscard]] size_t emit_displacement() noexcept {
+        const auto result = position();
+        emit_u32(0);
+        return result;
+    }
+
+    void rex(bool wide, u8 reg, u8 base) noexcept {
+        const auto prefix = static_cast<u8>(
+            0x40U | (wide ? 0x08U : 0U) | ((reg >> 3U) << 2U) | (base >> 3U)
+        );
+        if (prefix != 0x40) { emit_u8(prefix); }
+    }
+
+    void modrm_reg(u8 reg, u8 base) noexcept {
+        emit_u8(static_cast<u8>(0xc0U | ((reg & 7U) << 3U) | (base & 7U)));
+    }
+
+    // Always with a displacement, [rbp] and [r13] have no short form
+    void modrm_mem(u8 reg, Mem mem) noexcept {
+        const auto base = to_underlying(mem.base);
+        const bool is_short = mem.disp >= -128 && mem.disp <= 127;
+        emit_u8(static_cast<u8>(
+            (is_short ? 0x40U : 0x80U) | ((reg & 7U) << 3U) | (base & 7U)
+        ));
+        // [rsp] and [r12] need a SIB byte
+        if ((base & 7U) == 4U) { emit_u8(0x24); }
+        if (is_short) {
+            emit_u8(static_cast<u8>(mem.disp));
+        } else {
+            emit_u32(static_cast<u32>(mem.disp));
+        }
+    }
+
+    template <typename R>
+    void op_mem(
+        u8 prefix,
+        bool wide,
+        std::initializer_list<u8> opcode,
+        R reg,
+        Mem mem
+    ) noexcept {
+        if (prefix != 0) { emit_u8(prefix); }
+        const auto reg_bits = static_cast<u8>(reg);
+        rex(wide, reg_bits, to_underlying(mem.base));
+        for (auto byte : opcode) { emit_u8(byte); }
+        modrm_mem(reg_bits, mem);
+    }
+
+    void op_reg(u8 opcode, Reg dst, Reg src) noexcept {
+        rex(true, to_underlying(src), to_underlying(dst));
+        emit_u8(opcode);
+        modrm_reg(to_underlying(src), to_underlying(dst));
+    }
+
+    void op_imm(u8 extension, Reg dst, i32 imm) noexcept {
+        rex(true, 0, to_underlying(dst));
+        emit_u8(0x81);
+        modrm_reg(extension, to_underlying(dst));
+        emit_u32(static_cast<u32>(imm));
+    }
+
+    void shift(u8 extension, Reg dst, u8 count) noexcept {
+        rex(true, 0, to_underlying(dst));
+        emit_u8(0xc1);
+        modrm_reg(extension, to_underlying(dst));
+        emit_u8(count);
+    }
+
+    void op_sse(u8 prefix, u8 opcode, Xmm dst, Xmm src) noexcept {
+        emit_u8(prefix);
+        emit_u8(0x0f);
+        emit_u8(opcode);
+        modrm_reg(to_underlying(dst), to_underlying(src));
+    }
+};
+
+// Called by the native code for the instructions it does not inline, with
+// the instruction. Returns false, before any side effect, to leave the
+// instruction to the interpreter.
+using JitHelper = bool (*)(VM& tvm, const ByteCode* ip) noexcept;
+
+struct JitHelpers {
+    template <u8 N>
+    static bool define_global(VM& tvm, const ByteCode* ip) noexcept {
+        auto* frame = at(tvm, ip);
+        tvm.do_define_global<N>(frame);
+        return true;
+    }
+
+    template <u8 N>
+    static bool get_upvalue(VM& tvm, const ByteCode* ip) noexcept {
+        auto* frame = at(tvm, ip);
+        tvm.do_get_upvalue<N>(frame);
+        return true;
+    }
+
+    template <u8 N>
+    static bool set_upvalue(VM& tvm, const ByteCode* ip) noexcept {
+        auto* frame = at(tvm, ip);
+        tvm.do_set_upvalue<N>(frame);
+        return true;
+    }
+
+    template <u8 N>
+    static bool get_upvalue_copy(VM& tvm, const ByteCode* ip) noexcept {
+        auto* frame = at(tvm, ip);
+        tvm.do_get_upvalue_copy<N>(frame);
+        return true;
+    }
+
+    template <u8 N>
+    static bool end_scope(VM& tvm, const ByteCode* ip) noexcept {
+        auto* frame = at(tvm, ip);
+        tvm.do_end_scope<N>(frame);
+        return true;
+    }
+
+    template <template <typename> typename Op>
+    static bool local_constant_op_int(VM& tvm, const ByteCode* ip) noexcept {
+        auto* frame = at(tvm, ip);
+        tvm.do_local_constant_op_int<Op>(frame);
+        return true;
+    }
+
+    template <bool IS_EQUAL>
+    static bool equal(VM& tvm, const ByteCode* /*ip*/) noexcept {
+        const auto rhs = tvm.pop();
+        const auto lhs = tvm.pop();
+        tvm.push(Value((lhs == rhs) == IS_EQUAL));
+        return true;
+    }
+
+    template <template <typename> typename Op>
+    static bool binary_op(VM& tvm, const ByteCode* /*ip*/) noexcept {
+        if (!tvm.peek(0).is_number() || !tvm.peek(1).is_number())
+            [[unlikely]] {
+            return false;
+        }
+        const bool is_error = tvm.binary_op<Op>();
+        assert(!is_error);
+        (void)is_error;
+        return true;
+    }
+
+    static bool divide(VM& tvm, const ByteCode* ip) noexcept {
+        if (tvm.peek(0).is_int() && tvm.peek(1).is_int()
+            && tvm.peek(0).as_int() == 0) [[unlikely]] {
+            return false;
+        }
+        return binary_op<std::divides>(tvm, ip);
+    }
+
+    template <template <typename> typename Op>
+    static bool binary_op_int(VM& tvm, const ByteCode* /*ip*/) noexcept {
+        tvm.binary_op_int<Op>();
+        return true;
+    }
+
+    static bool divide_int(VM& tvm, const ByteCode* ip) noexcept {
+        if (tvm.peek(0).as_int() == 0) [[unlikely]] { return false; }
+        return binary_op_int<std::divides>(tvm, ip);
+    }
+
+    template <template <typename> typename Op>
+    static bool binary_op_float(VM& tvm, const ByteCode* /*ip*/) noexcept {
+        tvm.binary_op_float<Op>();
+        return true;
+    }
+
+    static bool not_op(VM& tvm, const ByteCode* /*ip*/) noexcept {
+        tvm.push(Value(tvm.pop().is_falsey()));
+        return true;
+    }
+
+    static bool negate(VM& tvm, const ByteCode* /*ip*/) noexcept {
+        if (!tvm.peek(0).is_number()) [[unlikely]] { return false; }
+        const bool is_error = tvm.negate_op();
+        assert(!is_error);
+        (void)is_error;
+        return true;
+    }
+
+  private:
+    // Frame whose operands the functions of the interpreter read
+    static CallFrame* at(VM& tvm, const ByteCode* ip) noexcept {
+        auto* frame = &tvm.frames.back();
+        frame->instruction_ptr = std::next(ip);
+        return frame;
+    }
+};
+
+#ifdef TX_ENABLE_NAN_BOXING
+// Integers may be boxed, number operations are left to the helpers
+inline constexpr bool JIT_INLINE_NUMBERS = false;
+inline constexpr i32 JIT_PAYLOAD_OFFSET = 0;
+#else
+inline constexpr bool JIT_INLINE_NUMBERS = true;
+inline constexpr i32 JIT_PAYLOAD_OFFSET = offsetof(Value, as);
+static_assert(offsetof(Value, type) == 0 && sizeof(Value::Type) == 4);
+#endif
+
+// Translation of the bytecode of a function, one template per instruction.
+//
+// The native code keeps the VM, the instruction pointer of the frame, the
+// slots, the stack and its size in callee saved registers, with the top of
+// the stack cached in a register. The size of the stack is written back
+// before calling a helper or leaving, and read again after the call.
+class JitCompiler {
+    struct Fixup {
+        static constexpr bool IS_TRIVIALLY_RELOCATABLE = true;
+
+        size_t displacement;
+        size_t target;
+    };
+
+    static constexpr Reg VM_REG = Reg::RBX;
+    static constexpr Reg IP_REG = Reg::R14;
+    static constexpr Reg SLOTS_REG = Reg::R13;
+    static constexpr Reg SIZE_REG = Reg::R15;
+    static constexpr Reg STACK_REG = Reg::RBP;
+    static constexpr Reg TOP_REG = Reg::R12;
+    static constexpr i32 VALUE_SIZE = sizeof(Value);
+    static constexpr u8 VALUE_SHIFT = std::countr_zero(sizeof(Value));
+
+    VM& tvm;
+    const ObjFunction& function;
+    X86Assembler masm;
+    DynArray<u32, size_t, false> entries;
+    DynArray<Fixup, size_t, false> fixups;
+    size_t exit_position{0};
+
+  public:
+    JitCompiler(VM& tvm_, const ObjFunction& function_) noexcept
+            : tvm(tvm_)
+            , function(function_)
+            , masm(tvm_) {}
+    JitCompiler(const JitCompiler& other) = delete;
+    JitCompiler(JitCompiler&& other) = delete;
+
+    ~JitCompiler() noexcept {
+        entries.destroy(tvm);
+        fixups.destroy(tvm);
+    }
+
+    JitCompiler& operator=(const JitCompiler& rhs) = delete;
+    JitCompiler& operator=(JitCompiler&& rhs) = delete;
+
+    [[nodiscard]] JitCode* compile() noexcept;
+
+  private:
+    [[nodiscard]] JitCode* map_code() const noexcept;
+
+    [[nodiscard]] size_t emit_instruction(size_t offset) noexcept;
+
+    void emit_entry() noexcept;
+    void emit_exit_stub() noexcept;
+    void emit_exit(const ByteCode* ip) noexcept;
+    void emit_helper(const ByteCode* ip, JitHelper helper) noexcept;
+    void emit_jump(size_t target) noexcept;
+    void emit_jump_if(Cond cond, size_t target) noexcept;
+    void emit_jump_if_false(size_t target) noexcept;
+    void emit_push(Value value) noexcept;
+    void emit_copy(Mem dst, Mem src) noexcept;
+    void emit_store_bool(size_t distance) noexcept;
+    void emit_get_local(size_t slot) noexcept;
+    void emit_set_local(size_t slot) noexcept;
+    [[nodiscard]] Mem emit_load_global(size_t index) noexcept;
+    void emit_exit_if_none(const ByteCode* ip, Mem value) noexcept;
+    void emit_get_global(const ByteCode* ip, size_t index) noexcept;
+    void emit_set_global(const ByteCode* ip, size_t index) noexcept;
+    void emit_string_compare(Cond cond) noexcept;
+    void emit_int_op(OpCode opcode) noexcept;
+    void emit_int_compare(Cond cond) noexcept;
+    void emit_guarded_int_op(
+        const ByteCode* ip,
+        JitHelper helper,
+        OpCode opcode,
+        Cond cond
+    ) noexcept;
+    void emit_load_number(Xmm dst, size_t distance) noexcept;
+    void emit_float_op(OpCode opcode) noexcept;
+    void emit_float_compare(Cond cond, bool is_swapped) noexcept;
+    void emit_local_constant_op_int(OpCode opcode, size_t operand) noexcept;
+
+    void sync_stack_size() noexcept {
+        masm.mov(Reg::RAX, TOP_REG);
+        masm.sub(Reg::RAX, STACK_REG);
+        masm.sar(Reg::RAX, VALUE_SHIFT);
+        masm.mov(Mem{SIZE_REG, 0}, Reg::RAX);
+    }
+
+    void load_stack_top() noexcept {
+        masm.mov(TOP_REG, Mem{SIZE_REG, 0});
+        masm.shl(TOP_REG, VALUE_SHIFT);
+        masm.add(TOP_REG, STACK_REG);
+    }
+
+    // Value at distance from the top of the stack, as in VM::peek()
+    [[nodiscard]] static constexpr Mem
+    peek(size_t distance, i32 field) noexcept {
+        const auto disp = static_cast<i32>(-(distance + 1) * VALUE_SIZE);
+        return Mem{TOP_REG, disp + field};
+    }
+
+    [[nodiscard]] static constexpr Mem type_of(size_t distance) noexcept {
+        return peek(distance, 0);
+    }
+
+    [[nodiscard]] static constexpr Mem payload_of(size_t distance) noexcept {
+        return peek(distance, JIT_PAYLOAD_OFFSET);
+    }
+
+    [[nodiscard]] static constexpr u32 type_tag(Value::Type type) noexcept {
+        return static_cast<u32>(to_underlying(type));
+    }
+};
+
+inline JitCode* JitCompiler::compile() noexcept {
+    const auto& code = function.chunk.code;
+    emit_entry();
+    emit_exit_stub();
+    entries.resize(tvm, code.size() + 1, 0);
+    size_t offset = 0;
+    while (offset < code.size()) {
+        entries[offset] = static_cast<u32>(masm.position());
+        offset += emit_instruction(offset);
+    }
+    // Never reached, the bytecode ends with a RETURN or an END
+    entries[offset] = static_cast<u32>(masm.position());
+    emit_exit(code.cend());
+    for (const auto& fixup : fixups) {
+        assert(fixup.target <= code.size());
+        assert(fixup.target == code.size() || entries[fixup.target] != 0);
+        masm.bind_to(fixup.displacement, entries[fixup.target]);
+    }
+    return map_code();
+}
+
+inline JitCode* JitCompiler::map_code() const noexcept {
+    const auto entries_size = entries.size() * size_cast(sizeof(u32));
+    const auto code_offset = (size_cast(sizeof(JitCode)) + entries_size + 15)
+                             & ~size_t{15};
+    const auto map_size = code_offset + masm.position();
+    const auto length = static_cast<std::size_t>(map_size);
+    void* memory = mmap(
+        nullptr,
+        length,
+        PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS,
+        -1,
+        0
+    );
+    if (memory == MAP_FAILED) { return nullptr; }
+    auto* result = std::construct_at(
+        static_cast<JitCode*>(memory),
+        JitCode{
+            .map_size = map_size,
+            .code_offset = code_offset,
+            .entry_count = entries.size(),
+        }
+    );
+    std::memcpy(
+        std::next(result),
+        entries.data(),
+        static_cast<std::size_t>(entries_size)
+    );
+    std::memcpy(
+        std::next(static_cast<u8*>(memory), code_offset),
+        masm.data(),
+        static_cast<std::size_t>(masm.position())
+    );
+    if (mprotect(memory, length, PROT_READ | PROT_EXEC) != 0) {
+        munmap(memory, length);
+        return nullptr;
+    }
+    return result;
+}
+
+// Called as void(VM*, const ByteCode** ip, Value* slots, size_t* stack_size,
+// Value* stack, const u8* target), see jit_run()
+inline void JitCompiler::emit_entry() noexcept {
+    for (auto reg : {Reg::RBX, Reg::RBP, Reg::R12, Reg::R13, Reg::R14, Reg::R15}
+    ) {
+        masm.push(reg);
+    }
+    // Align the stack of the calls to the helpers
+    masm.sub(Reg::RSP, 8);
+    masm.mov(VM_REG, Reg::RDI);
+    masm.mov(IP_REG, Reg::RSI);
+    masm.mov(SLOTS_REG, Reg::RDX);
+    masm.mov(SIZE_REG, Reg::RCX);
+    masm.mov(STACK_REG, Reg::R8);
+    load_stack_top();
+    masm.jmp(Reg::R9);
+}
+
+inline void JitCompiler::emit_exit_stub() noexcept {
+    exit_position = masm.position();
+    sync_stack_size();
+    masm.add(Reg::RSP, 8);
+    for (auto reg : {Reg::R15, Reg::R14, Reg::R13, Reg::R12, Reg::RBP, Reg::RBX}
+    ) {
+        masm.pop(reg);
+    }
+    masm.ret();
+}
+
+// Leave the native code, the interpreter continues at ip
+inline void JitCompiler::emit_exit(const ByteCode* ip) noexcept {
+    // NOLINTNEXTLINE(*-reinterpret-cast)
+    masm.mov(Reg::RAX, reinterpret_cast<u64>(ip));
+    masm.mov(Mem{IP_REG, 0}, Reg::RAX);
+    masm.bind_to(masm.jmp(), exit_position);
+}
+
+inline void
+JitCompiler::emit_helper(const ByteCode* ip, JitHelper helper) noexcept {
+    sync_stack_size();
+    masm.mov(Reg::RDI, VM_REG);
+    // NOLINTNEXTLINE(*-reinterpret-cast)
+    masm.mov(Reg::RSI, reinterpret_cast<u64>(ip));
+    // NOLINTNEXTLINE(*-reinterpret-cast)
+    masm.mov(Reg::RAX, reinterpret_cast<u64>(helper));
+    masm.call(Reg::RAX);
+    masm.test_al();
+    const auto handled = masm.jcc(Cond::NE);
+    emit_exit(ip);
+    masm.bind(handled);
+    load_stack_top();
+}
+
+inline void JitCompiler::emit_jump(size_t target) noexcept {
+    fixups.push_back(tvm, Fixup{.displacement = masm.jmp(), .target = target});
+}
+
+inline void JitCompiler::emit_jump_if(Cond cond, size_t target) noexcept {
+    fixups.push_back(
+        tvm,
+        Fixup{.displacement = masm.jcc(cond), .target = target}
+    );
+}
+
+// The condition stays on the stack, as in the interpreter
+inline void JitCompiler::emit_jump_if_false(size_t target) noexcept {
+#ifdef TX_ENABLE_NAN_BOXING
+    masm.mov(Reg::RAX, payload_of(0));
+    masm.shr(Reg::RAX, Value::TAG_SHIFT);
+    masm.cmp(Reg::RAX, static_cast<i32>(Value::TAG_NIL));
+    emit_jump_if(Cond::E, target);
+    masm.mov(Reg::RAX, payload_of(0));
+    masm.mov(Reg::RCX, Value{false}.bits);
+    masm.cmp(Reg::RAX, Reg::RCX);
+    emit_jump_if(Cond::E, target);
+#else
+    masm.cmp32(type_of(0), type_tag(Value::Type::NIL));
+    emit_jump_if(Cond::E, target);
+    masm.cmp32(type_of(0), type_tag(Value::Type::BOOL));
+    const auto is_not_bool = masm.jcc(Cond::NE);
+    masm.cmp8(payload_of(0), 0);
+    emit_jump_if(Cond::E, target);
+    masm.bind(is_not_bool);
+#endif
+}
+
+inline void JitCompiler::emit_push(Value value) noexcept {
+#ifdef TX_ENABLE_NAN_BOXING
+    masm.mov(Reg::RAX, value.bits);
+    masm.mov(Mem{TOP_REG, 0}, Reg::RAX);
+#else
+    u64 payload = 0;
+    std::memcpy(&payload, &value.as, sizeof(payload));
+    masm.mov32(Mem{TOP_REG, 0}, type_tag(value.type));
+    masm.mov(Reg::RAX, payload);
+    masm.mov(Mem{TOP_REG, JIT_PAYLOAD_OFFSET}, Reg::RAX);
+#endif
+    masm.add(TOP_REG, VALUE_SIZE);
+}
+
+inline void JitCompiler::emit_copy(Mem dst, Mem src) noexcept {
+    if constexpr (sizeof(Value) == 16) {
+        masm.movups(Xmm::XMM0, src);
+        masm.movups(dst, Xmm::XMM0);
+    } else {
+        masm.mov(Reg::RAX, src);
+        masm.mov(dst, Reg::RAX);
+    }
+}
+
+// Replace the value at distance by the Bool in eax
+inline void JitCompiler::emit_store_bool(size_t distance) noexcept {
+#ifdef TX_ENABLE_NAN_BOXING
+    masm.mov(Reg::RCX, Value{false}.bits);
+    masm.add(Reg::RAX, Reg::RCX);
+    masm.mov(peek(distance, 0), Reg::RAX);
+#else
+    masm.mov32(type_of(distance), type_tag(Value::Type::BOOL));
+    masm.mov(payload_of(distance), Reg::RAX);
+#endif
+}
+
+inline void JitCompiler::emit_get_local(size_t slot) noexcept {
+    emit_copy(
+        Mem{TOP_REG, 0},
+        Mem{SLOTS_REG, static_cast<i32>(slot * VALUE_SIZE)}
+    );
+    masm.add(TOP_REG, VALUE_SIZE);
+}
+
+inline void JitCompiler::emit_set_local(size_t slot) noexcept {
+    emit_copy(
+        Mem{SLOTS_REG, static_cast<i32>(slot * VALUE_SIZE)},
+        peek(0, 0)
+    );
+}
+
+// The globals are reallocated when later scripts define more of them, the
+// address of their data is read on each access
+inline Mem JitCompiler::emit_load_global(size_t index) noexcept {
+    const auto* const* globals = tvm.global_values.data_ptr_ptr();
+    // NOLINTNEXTLINE(*-reinterpret-cast)
+    masm.mov(Reg::RCX, reinterpret_cast<u64>(globals));
+    masm.mov(Reg::RCX, Mem{Reg::RCX, 0});
+    return Mem{Reg::RCX, static_cast<i32>(index * VALUE_SIZE)};
+}
+
+// Undefined globals are reported by the interpreter
+inline void
+JitCompiler::emit_exit_if_none(const ByteCode* ip, Mem value) noexcept {
+#ifdef TX_ENABLE_NAN_BOXING
+    masm.mov(Reg::RAX, value);
+    masm.shr(Reg::RAX, static_cast<u8>(Value::TAG_SHIFT));
+    masm.cmp(Reg::RAX, static_cast<i32>(Value::TAG_NONE));
+#else
+    masm.cmp32(value, type_tag(Value::Type::NONE));
+#endif
+    const auto is_defined = masm.jcc(Cond::NE);
+    emit_exit(ip);
+    masm.bind(is_defined);
+}
+
+inline void
+JitCompiler::emit_get_global(const ByteCode* ip, size_t index) noexcept {
+    const auto global = emit_load_global(index);
+    emit_exit_if_none(ip, global);
+    emit_copy(Mem{TOP_REG, 0}, global);
+    masm.add(TOP_REG, VALUE_SIZE);
+}
+
+inline void
+JitCompiler::emit_set_global(const ByteCode* ip, size_t index) noexcept {
+    const auto global = emit_load_global(index);
+    emit_exit_if_none(ip, global);
+    emit_copy(global, peek(0, 0));
+}
+
+// Strings are interned, compare addresses
+inline void JitCompiler::emit_string_compare(Cond cond) noexcept {
+    masm.mov(Reg::RAX, payload_of(1));
+    masm.cmp(Reg::RAX, payload_of(0));
+    masm.setcc_eax(cond);
+    emit_store_bool(1);
+    masm.sub(TOP_REG, VALUE_SIZE);
+}
+
+// Operands are Int, the type of the result is already the type of the left
+// operand
+inline void JitCompiler::emit_int_op(OpCode opcode) noexcept {
+    masm.mov(Reg::RAX, payload_of(1));
+    switch (opcode) {
+        using enum OpCode;
+        case ADD_INT: masm.add(Reg::RAX, payload_of(0)); break;
+        case SUBSTRACT_INT: masm.sub(Reg::RAX, payload_of(0)); break;
+        case MULTIPLY_INT: masm.imul(Reg::RAX, payload_of(0)); break;
+        default: unreachable();
+    }
+    masm.mov(payload_of(1), Reg::RAX);
+    masm.sub(TOP_REG, VALUE_SIZE);
+}
+
+// Leaves the result in al, for LESS_INT_JUMP_IF_FALSE
+inline void JitCompiler::emit_int_compare(Cond cond) noexcept {
+    masm.mov(Reg::RAX, payload_of(1));
+    masm.cmp(Reg::RAX, payload_of(0));
+    masm.setcc_eax(cond);
+    emit_store_bool(1);
+    masm.sub(TOP_REG, VALUE_SIZE);
+}
+
+// Int fast path of a generic operation, the helper handles the others
+inline void JitCompiler::emit_guarded_int_op(
+    const ByteCode* ip,
+    JitHelper helper,
+    OpCode opcode,
+    Cond cond
+) noexcept {
+    masm.cmp32(type_of(1), type_tag(Value::Type::INT));
+    const auto lhs_not_int = masm.jcc(Cond::NE);
+    masm.cmp32(type_of(0), type_tag(Value::Type::INT));
+    const auto rhs_not_int = masm.jcc(Cond::NE);
+    if (opcode == OpCode::END) {
+        emit_int_compare(cond);
+    } else {
+        emit_int_op(opcode);
+    }
+    const auto done = masm.jmp();
+    masm.bind(lhs_not_int);
+    masm.bind(rhs_not_int);
+    emit_helper(ip, helper);
+    masm.bind(done);
+}
+
+// Int operands of float operations are converted
+inline void JitCompiler::emit_load_number(Xmm dst, size_t distance) noexcept {
+    masm.cmp32(type_of(distance), type_tag(Value::Type::FLOAT));
+    const auto is_int = masm.jcc(Cond::NE);
+    masm.movsd(dst, payload_of(distance));
+    const auto done = masm.jmp();
+    masm.bind(is_int);
+    masm.cvtsi2sd(dst, payload_of(distance));
+    masm.bind(done);
+}
+
+inline void JitCompiler::emit_float_op(OpCode opcode) noexcept {
+    emit_load_number(Xmm::XMM0, 1);
+    emit_load_number(Xmm::XMM1, 0);
+    switch (opcode) {
+        using enum OpCode;
+        case ADD_FLOAT: masm.addsd(Xmm::XMM0, Xmm::XMM1); break;
+        case SUBSTRACT_FLOAT: masm.subsd(Xmm::XMM0, Xmm::XMM1); break;
+        case MULTIPLY_FLOAT: masm.mulsd(Xmm::XMM0, Xmm::XMM1); break;
+        case DIVIDE_FLOAT: masm.divsd(Xmm::XMM0, Xmm::XMM1); break;
+        default: unreachable();
+    }
+    masm.mov32(type_of(1), type_tag(Value::Type::FLOAT));
+    masm.movsd(payload_of(1), Xmm::XMM0);
+    masm.sub(TOP_REG, VALUE_SIZE);
+}
+
+// Only the unsigned above conditions are false for unordered operands (NaN),
+// less comparisons swap the operands
+inline void
+JitCompiler::emit_float_compare(Cond cond, bool is_swapped) noexcept {
+    emit_load_number(Xmm::XMM0, 1);
+    emit_load_number(Xmm::XMM1, 0);
+    if (is_swapped) {
+        masm.ucomisd(Xmm::XMM1, Xmm::XMM0);
+    } else {
+        masm.ucomisd(Xmm::XMM0, Xmm::XMM1);
+    }
+    masm.setcc_eax(cond);
+    emit_store_bool(1);
+    masm.sub(TOP_REG, VALUE_SIZE);
+}
+
+inline void JitCompiler::emit_local_constant_op_int(
+    OpCode opcode,
+    size_t operand
+) noexcept {
+    const auto slot = operand & 0xff;
+    const auto constant = function.chunk.constants[operand >> 8];
+    masm.mov(
+        Reg::RAX,
+        Mem{SLOTS_REG, static_cast<i32>(slot * VALUE_SIZE) + JIT_PAYLOAD_OFFSET}
+    );
+    masm.mov(Reg::RCX, static_cast<u64>(constant.as_int()));
+    if (opcode == OpCode::GET_LOCAL_CONSTANT_ADD_INT) {
+        masm.add(Reg::RAX, Reg::RCX);
+    } else {
+        masm.sub(Reg::RAX, Reg::RCX);
+    }
+    masm.mov32(Mem{TOP_REG, 0}, type_tag(Value::Type::INT));
+    masm.mov(Mem{TOP_REG, JIT_PAYLOAD_OFFSET}, Reg::RAX);
+    masm.add(TOP_REG, VALUE_SIZE);
+}
+
+// Returns the length of the instruction
+inline size_t JitCompiler::emit_instruction(size_t offset) noexcept {
+    const auto& chunk = function.chunk;
+    const auto* ip = std::next(chunk.code.cbegin(), offset);
+    const auto opcode = ip->as_opcode();
+    const auto operand_size = get_byte_count_following_opcode(opcode);
+    const auto* operand_ptr = std::next(ip);
+    const auto operand = [&]() -> size_t {
+        switch (operand_size) {
+            case 1: return read_multibyte_operand<1>(operand_ptr);
+            case 2: return read_multibyte_operand<2>(operand_ptr);
+            case 3: return read_multibyte_operand<3>(operand_ptr);
+            default: return 0;
+        }
+    }();
+    const auto end = offset + 1 + operand_size;
+    // Number operations, inline or with helpers
+    const auto int_op = [&](JitHelper helper) {
+        if constexpr (JIT_INLINE_NUMBERS) {
+            emit_int_op(opcode);
+        } else {
+            emit_helper(ip, helper);
+        }
+    };
+    const auto int_compare = [&](Cond cond, JitHelper helper) {
+        if constexpr (JIT_INLINE_NUMBERS) {
+            emit_int_compare(cond);
+        } else {
+            emit_helper(ip, helper);
+        }
+    };
+    const auto float_op = [&](JitHelper helper) {
+        if constexpr (JIT_INLINE_NUMBERS) {
+            emit_float_op(opcode);
+        } else {
+            emit_helper(ip, helper);
+        }
+    };
+    const auto float_compare = [&](Cond cond, bool swap, JitHelper helper) {
+        if constexpr (JIT_INLINE_NUMBERS) {
+            emit_float_compare(cond, swap);
+        } else {
+            emit_helper(ip, helper);
+        }
+    };
+    const auto generic_op = [&](JitHelper helper, OpCode fast_op, Cond cond) {
+        if constexpr (JIT_INLINE_NUMBERS) {
+            emit_guarded_int_op(ip, helper, fast_op, cond);
+        } else {
+            emit_helper(ip, helper);
+        }
+    };
+
+    switch (opcode) {
+        using enum OpCode;
+        case CONSTANT:
+        case CONSTANT_LONG: emit_push(chunk.constants[operand]); break;
+        case NIL: emit_push(Value{val_nil}); break;
+        case TRUE: emit_push(Value{true}); break;
+        case FALSE: emit_push(Value{false}); break;
+        case POP: masm.sub(TOP_REG, VALUE_SIZE); break;
+        case GET_LOCAL:
+        case GET_LOCAL_LONG: emit_get_local(operand); break;
+        case SET_LOCAL:
+        case SET_LOCAL_LONG: emit_set_local(operand); break;
+        case GET_GLOBAL:
+        case GET_GLOBAL_LONG: emit_get_global(ip, operand); break;
+        case SET_GLOBAL:
+        case SET_GLOBAL_LONG: emit_set_global(ip, operand); break;
+        case DEFINE_GLOBAL:
+            emit_helper(ip, &JitHelpers::define_global<1>);
+            break;
+        case DEFINE_GLOBAL_LONG:
+            emit_helper(ip, &JitHelpers::define_global<3>);
+            break;
+        case GET_UPVALUE: emit_helper(ip, &JitHelpers::get_upvalue<1>); break;
+        case GET_UPVALUE_LONG:
+            emit_helper(ip, &JitHelpers::get_upvalue<3>);
+            break;
+        case SET_UPVALUE: emit_helper(ip, &JitHelpers::set_upvalue<1>); break;
+        case SET_UPVALUE_LONG:
+            emit_helper(ip, &JitHelpers::set_upvalue<3>);
+            break;
+        case GET_UPVALUE_COPY:
+            emit_helper(ip, &JitHelpers::get_upvalue_copy<1>);
+            break;
+        case GET_UPVALUE_COPY_LONG:
+            emit_helper(ip, &JitHelpers::get_upvalue_copy<3>);
+            break;
+        case EQUAL: emit_helper(ip, &JitHelpers::equal<true>); break;
+        case NOT_EQUAL: emit_helper(ip, &JitHelpers::equal<false>); break;
+        // END marks the comparisons for emit_guarded_int_op()
+        case GREATER:
+            generic_op(&JitHelpers::binary_op<std::greater>, END, Cond::G);
+            break;
+        case GREATER_EQUAL:
+            generic_op(
+                &JitHelpers::binary_op<std::greater_equal>,
+                END,
+                Cond::GE
+            );
+            break;
+        case LESS:
+            generic_op(&JitHelpers::binary_op<std::less>, END, Cond::L);
+            break;
+        case LESS_EQUAL:
+            generic_op(&JitHelpers::binary_op<std::less_equal>, END, Cond::LE);
+            break;
+        case ADD:
+            generic_op(&JitHelpers::binary_op<std::plus>, ADD_INT, Cond::E);
+            break;
+        case SUBSTRACT:
+            generic_op(
+                &JitHelpers::binary_op<std::minus>,
+                SUBSTRACT_INT,
+                Cond::E
+            );
+            break;
+        case MULTIPLY:
+            generic_op(
+                &JitHelpers::binary_op<std::multiplies>,
+                MULTIPLY_INT,
+                Cond::E
+            );
+            break;
+        case DIVIDE: emit_helper(ip, &JitHelpers::divide); break;
+        case EQUAL_INT:
+            int_compare(Cond::E, &JitHelpers::binary_op_int<std::equal_to>);
+            break;
+        case NOT_EQUAL_INT:
+            int_compare(
+                Cond::NE,
+                &JitHelpers::binary_op_int<std::not_equal_to>
+            );
+            break;
+        case GREATER_INT:
+            int_compare(Cond::G, &JitHelpers::binary_op_int<std::greater>);
+            break;
+        case GREATER_EQUAL_INT:
+            int_compare(
+                Cond::GE,
+                &JitHelpers::binary_op_int<std::greater_equal>
+            );
+            break;
+        case LESS_INT:
+            int_compare(Cond::L, &JitHelpers::binary_op_int<std::less>);
+            break;
+        case LESS_EQUAL_INT:
+            int_compare(Cond::LE, &JitHelpers::binary_op_int<std::less_equal>);
+            break;
+        case ADD_INT: int_op(&JitHelpers::binary_op_int<std::plus>); break;
+        case SUBSTRACT_INT:
+            int_op(&JitHelpers::binary_op_int<std::minus>);
+            break;
+        case MULTIPLY_INT:
+            int_op(&JitHelpers::binary_op_int<std::multiplies>);
+            break;
+        case DIVIDE_INT: emit_helper(ip, &JitHelpers::divide_int); break;
+        case GREATER_FLOAT:
+            float_compare(
+                Cond::A,
+                false,
+                &JitHelpers::binary_op_float<std::greater>
+            );
+            break;
+        case GREATER_EQUAL_FLOAT:
+            float_compare(
+                Cond::AE,
+                false,
+                &JitHelpers::binary_op_float<std::greater_equal>
+            );
+            break;
+        case LESS_FLOAT:
+            float_compare(
+                Cond::A,
+                true,
+                &JitHelpers::binary_op_float<std::less>
+            );
+            break;
+        case LESS_EQUAL_FLOAT:
+            float_compare(
+                Cond::AE,
+                true,
+                &JitHelpers::binary_op_float<std::less_equal>
+            );
+            break;
+        case ADD_FLOAT:
+            float_op(&JitHelpers::binary_op_float<std::plus>);
+            break;
+        case SUBSTRACT_FLOAT:
+            float_op(&JitHelpers::binary_op_float<std::minus>);
+            break;
+        case MULTIPLY_FLOAT:
+            float_op(&JitHelpers::binary_op_float<std::multiplies>);
+            break;
+        case DIVIDE_FLOAT:
+            float_op(&JitHelpers::binary_op_float<std::divides>);
+            break;
+        case EQUAL_STRING: emit_string_compare(Cond::E); break;
+        case NOT_EQUAL_STRING: emit_string_compare(Cond::NE); break;
+        case NOT: emit_helper(ip, &JitHelpers::not_op); break;
+        case NEGATE: emit_helper(ip, &JitHelpers::negate); break;
+        case JUMP: emit_jump(end + operand); break;
+        case JUMP_IF_FALSE: emit_jump_if_false(end + operand); break;
+        case LOOP: emit_jump(end - operand); break;
+        case END_SCOPE: emit_helper(ip, &JitHelpers::end_scope<1>); break;
+        case END_SCOPE_LONG:
+            emit_helper(ip, &JitHelpers::end_scope<3>);
+            break;
+        // Frames are pushed and popped by the interpreter
+        case CALL:
+        case CALL_CLOSURE:
+        case CALL_NATIVE:
+        case CALL_GLOBAL:
+        case TAIL_CALL:
+        case TAIL_CALL_GLOBAL:
+        case RETURN:
+        case END: emit_exit(ip); break;
+        case CLOSURE:
+        case CLOSURE_LONG: {
+            emit_exit(ip);
+            const auto& closure_function =
+                chunk.constants[operand].as_object().as<ObjFunction>();
+            auto length = end - offset;
+            for (size_t i = 0; i < closure_function.upvalue_count; ++i) {
+                const auto [is_local, is_value, index, len] =
+                    read_closure_operand(std::next(ip, length));
+                length += len;
+            }
+            return length;
+        }
+        case GET_LOCAL_GET_LOCAL:
+            emit_get_local(operand & 0xff);
+            emit_get_local(operand >> 8);
+            break;
+        case GET_LOCAL_CONSTANT_ADD_INT:
+            if constexpr (JIT_INLINE_NUMBERS) {
+                emit_local_constant_op_int(opcode, operand);
+            } else {
+                emit_helper(ip, &JitHelpers::local_constant_op_int<std::plus>);
+            }
+            break;
+        case GET_LOCAL_CONSTANT_SUBSTRACT_INT:
+            if constexpr (JIT_INLINE_NUMBERS) {
+                emit_local_constant_op_int(opcode, operand);
+            } else {
+                emit_helper(
+                    ip,
+                    &JitHelpers::local_constant_op_int<std::minus>
+                );
+            }
+            break;
+        case LESS_INT_JUMP_IF_FALSE:
+            if constexpr (JIT_INLINE_NUMBERS) {
+                emit_int_compare(Cond::L);
+                masm.test_al();
+                emit_jump_if(Cond::E, end + operand);
+            } else {
+                emit_helper(ip, &JitHelpers::binary_op_int<std::less>);
+                emit_jump_if_false(end + operand);
+            }
+            break;
+    }
+    return end - offset;
+}
+
+inline JitCode* jit_compile(VM& tvm, const ObjFunction& function) noexcept {
+    JitCompiler compiler(tvm, function);
+    return compiler.compile();
+}
+
+inline void jit_run(VM& tvm, const JitCode& code, CallFrame& frame) noexcept {
+    using Entry = void (*)(
+        VM* tvm,
+        const ByteCode** ip,
+        Value* slots,
+        size_t* stack_size,
+        Value* stack,
+        const u8* target
+    ) noexcept;
+    const auto offset = std::distance(
+        frame.closure.function.chunk.code.cbegin(),
+        frame.instruction_ptr
+    );
+    assert(offset < code.entry_count);
+    const auto target = code.entries()[offset];
+    assert(target != 0);
+    // NOLINTNEXTLINE(*-reinterpret-cast)
+    const auto entry = reinterpret_cast<Entry>(code.code());
+    entry(
+        &tvm,
+        &frame.instruction_ptr,
+        frame.slots,
+        tvm.stack.size_ptr(),
+        tvm.stack.data(),
+        std::next(code.code(), target)
+    );
+}
+
+inline void free_jit_code(JitCode* code) noexcept {
+    munmap(code, static_cast<std::size_t>(code->map_size));
+}
+
+#else
+
+inline JitCode*
+jit_compile(VM& /*tvm*/, const ObjFunction& /*function*/) noexcept {
+    return nullptr;
+}
+
+inline void jit_run(
+    VM& /*tvm*/,
+    const JitCode& /*code*/,
+    CallFrame& /*frame*/
+) noexcept {
+    unreachable();
+}
+
+inline void free_jit_code(JitCode* /*code*/) noexcept {}
+
+#endif
+
+}  // namespace tx
@@ -11,10 +11,11 @@ namespace tx {
 
 class VM;
 struct Obj;
+struct Value;
 
-template <typename T>
+template <typename T, bool TRIGGER_GC = true>
 [[nodiscard]] T* allocate(VM& tvm, size_t count) noexcept {
-    return reallocate_no_reloc<T>(tvm, nullptr, 0, count);
+    return reallocate_no_reloc<T, TRIGGER_GC>(tvm, nullptr, 0, count);
 }
 
 template <typename T>
@@ -48,7 +49,7 @@ reallocate(VM& tvm, T* pointer, size_t old_size, size_t new_size) noexcept {
     ));
 }
 
-template <typename T>
+template <typename T, bool TRIGGER_GC = true>
 [[nodiscard]] constexpr T* reallocate_no_reloc(
     VM& tvm,
     T* pointer,
@@ -56,7 +57,7 @@ template <typename T>
     size_t new_size
 ) noexcept {
     assert((pointer == nullptr && old_size == 0) || (new_size == 0));
-    return static_cast<T*>(reallocate_impl(
+    return static_cast<T*>(reallocate_impl<TRIGGER_GC>(
         tvm,
         pointer,
         static_cast<size_t>(sizeof(T)) * old_size,
@@ -72,13 +73,23 @@ grow_array(VM& tvm, T* pointer, size_t old_size, size_t new_size) noexcept {
     return reallocate<T, TRIGGER_GC>(tvm, pointer, old_size, new_size);
 }
 
-template <typename T>
+// TRIGGER_GC must match the allocation, the GC only accounts for the memory
+// it can trigger on
+template <typename T, bool TRIGGER_GC = true>
 constexpr void free_array(VM& tvm, T* pointer, size_t old_size) noexcept {
-    (void)reallocate_no_reloc(tvm, pointer, old_size, 0);
+    (void)reallocate_no_reloc<T, TRIGGER_GC>(tvm, pointer, old_size, 0);
 }
 
 inline constexpr void free_objects(VM& tvm, Obj* objects) noexcept;
 
-constexpr void collect_garbage(VM& tvm) noexcept;
+constexpr void collect_garbage(VM& tvm, bool is_major) noexcept;
+constexpr void maybe_collect_garbage(VM& tvm) noexcept;
+
+// Generational GC write barriers, to call after storing a reference into an
+// object that can be old
+constexpr void remember_object(VM& tvm, Obj& obj) noexcept;
+constexpr void write_barrier(VM& tvm, Obj& owner, const Obj* child) noexcept;
+TX_VALUE_CONSTEXPR void
+write_barrier(VM& tvm, Obj& owner, const Value& value) noexcept;
 
 }  // namespace tx
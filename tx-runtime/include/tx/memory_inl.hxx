@@ -2,13 +2,16 @@
 
 #include "tx/common.hxx"
 #include "tx/compiler.hxx"
+#include "tx/jit.hxx"
 #include "tx/memory.hxx"
 
 #include "tx/vm.hxx"
 
 #include <gsl/gsl>
 
+#include <algorithm>
 #include <cassert>
+#include <chrono>
 #include <memory>
 
 namespace tx {
@@ -18,41 +21,13 @@ namespace tx {
 
 inline constexpr size_t MIN_CAPACIY = 8;
 inline constexpr size_t CAPACITY_SCALE_FACTOR = 2;
-inline constexpr size_t GC_HEAP_GROW_FACTOR = 2;
+inline constexpr size_t DEBUG_MINOR_GC_PER_MAJOR = 3;
 
 [[nodiscard]] inline constexpr size_t grow_capacity(size_t capacity) noexcept {
     return (capacity < MIN_CAPACIY) ? MIN_CAPACIY
                                     : (capacity * CAPACITY_SCALE_FACTOR);
 }
 
-// pmr::polymorphic_allocator does not provide a reallocate() function :(
-// constexpr
-inline void* allocator_reallocate(
-    Allocator alloc,
-    void* pointer,
-    size_t old_size,
-    size_t new_size,
-    size_t alignment
-) noexcept {
-    auto* result = alloc.allocate_bytes(
-        static_cast<std::size_t>(new_size),
-        static_cast<std::size_t>(alignment)
-    );
-    if (pointer != nullptr) {
-        std::copy_n(
-            static_cast<std::byte*>(pointer),
-            std::min(old_size, new_size),
-            static_cast<std::byte*>(result)
-        );
-        alloc.deallocate_bytes(
-            pointer,
-            static_cast<std::size_t>(old_size),
-            static_cast<std::size_t>(alignment)
-        );
-    }
-    return result;
-}
-
 template <bool TRIGGER_GC>
 // constexpr
 inline void* reallocate_impl(
@@ -64,34 +39,14 @@ inline void* reallocate_impl(
 ) noexcept {
     if constexpr (TRIGGER_GC) {
         tvm.bytes_allocated += new_size - old_size;
-        if (new_size > old_size) {
-            if constexpr (IS_DEBUG_BUILD) {
-                collect_garbage(tvm);
-            } else {
-                if (tvm.bytes_allocated > tvm.next_gc) {
-                    tvm.next_gc *= GC_HEAP_GROW_FACTOR;
-                    collect_garbage(tvm);
-                }
-            }
-        }
+        if (new_size > old_size) { maybe_collect_garbage(tvm); }
     }
 
-    if (new_size == 0) {
-        tvm.get_allocator().deallocate_bytes(
-            pointer,
-            static_cast<std::size_t>(old_size),
-            static_cast<std::size_t>(alignment)
-        );
-        return nullptr;
+    void* result =
+        tvm.allocator.reallocate(pointer, old_size, new_size, alignment);
+    if (result == nullptr && new_size != 0) {
+        report_and_abort("Out of memory.");
     }
-    void* result = allocator_reallocate(
-        tvm.get_allocator(),
-        pointer,
-        old_size,
-        new_size,
-        alignment
-    );
-    if (result == nullptr) { report_and_abort("Out of memory."); }
     return result;
 }
 
@@ -103,6 +58,27 @@ constexpr void free_object_impl(VM& tvm, T* object) noexcept {
     free<T>(tvm, object);
 }
 
+[[nodiscard]] inline constexpr size_t object_size(const Obj& object) noexcept {
+    switch (object.type) {
+        using enum Obj::ObjType;
+        case CLOSURE: {
+            const auto& closure = object.as<ObjClosure>();
+            return static_cast<size_t>(sizeof(ObjClosure))
+                   + closure.upvalue_count * static_cast<size_t>(sizeof(Value));
+        }
+        case FUNCTION: return sizeof(ObjFunction);
+        case NATIVE: return sizeof(ObjNative);
+        case STRING: {
+            const auto& str = object.as<ObjString>();
+            return static_cast<size_t>(sizeof(ObjString))
+                   + (str.owns_chars ? str.length : 0);
+        }
+        case UPVALUE: return sizeof(ObjUpvalue);
+        case INT: return sizeof(ObjInt);
+    }
+    unreachable();
+}
+
 inline void free_object(VM& tvm, Obj* object) noexcept {
     if constexpr (HAS_DEBUG_FEATURES) {
         if (tvm.get_options().trace_gc) {
@@ -114,35 +90,43 @@ inline void free_object(VM& tvm, Obj* object) noexcept {
             );
         }
     }
+    auto& stats = tvm.object_stats[to_underlying(object->type)];
+    --stats.count;
+    stats.bytes -= object_size(*object);
     switch (object->type) {
         using enum Obj::ObjType;
         case CLOSURE: {
             auto& closure = object->as<ObjClosure>();
-            closure.destroy(tvm);
-            free_object_impl(tvm, &closure);
+            const auto size = object_size(closure);
+            std::destroy_at(&closure);
+            (void)reallocate_impl(tvm, &closure, size, 0, alignof(ObjClosure));
             return;
         }
         case FUNCTION: {
             auto& fun = object->as<ObjFunction>();
+            if (tvm.profiler != nullptr) { tvm.profiler->forget_object(fun); }
+            if (fun.jit_code != nullptr) { free_jit_code(fun.jit_code); }
             fun.destroy(tvm);
             free_object_impl(tvm, &fun);
             return;
         }
-        case NATIVE: free_object_impl(tvm, &object->as<ObjNative>()); return;
+        case NATIVE: {
+            auto& native = object->as<ObjNative>();
+            if (tvm.profiler != nullptr) {
+                tvm.profiler->forget_object(native);
+            }
+            free_object_impl(tvm, &native);
+            return;
+        }
         case STRING: {
             auto& str = object->as<ObjString>();
+            const auto size = object_size(str);
             std::destroy_at(&str);
-            (void)reallocate_impl(
-                tvm,
-                &str,
-                static_cast<size_t>(sizeof(ObjString))
-                    + (str.owns_chars ? str.length : 0),
-                0,
-                alignof(ObjString)
-            );
+            (void)reallocate_impl(tvm, &str, size, 0, alignof(ObjString));
             return;
         }
         case UPVALUE: free_object_impl(tvm, &object->as<ObjUpvalue>()); return;
+        case INT: free_object_impl(tvm, &object->as<ObjInt>()); return;
     }
     unreachable();
 }
@@ -157,9 +141,30 @@ inline constexpr void free_objects(VM& tvm, Obj* objects) noexcept {
     }
 }
 
+inline constexpr void remember_object(VM& tvm, Obj& obj) noexcept {
+    if (obj.is_old && !obj.is_remembered) {
+        obj.is_remembered = true;
+        tvm.remembered_set.push_back(tvm, &obj);
+    }
+}
+
+inline constexpr void
+write_barrier(VM& tvm, Obj& owner, const Obj* child) noexcept {
+    if (owner.is_old && child != nullptr && !child->is_old) [[unlikely]] {
+        remember_object(tvm, owner);
+    }
+}
+
+inline TX_VALUE_CONSTEXPR void
+write_barrier(VM& tvm, Obj& owner, const Value& value) noexcept {
+    write_barrier(tvm, owner, value.get_object_or_null());
+}
+
 inline constexpr void mark_object(VM& tvm, Obj* obj) noexcept {
     if (obj == nullptr) { return; }
     if (obj->is_marked) { return; }
+    // Minor collections only trace young objects
+    if (tvm.is_minor_gc && obj->is_old) { return; }
     if constexpr (HAS_DEBUG_FEATURES) {
         if (tvm.get_options().trace_gc) {
             fmt::print(FMT_STRING("{} mark {}\n"), fmt::ptr(obj), Value(obj));
@@ -169,8 +174,9 @@ inline constexpr void mark_object(VM& tvm, Obj* obj) noexcept {
     tvm.gray_stack.emplace_back(tvm, obj);
 }
 
-inline constexpr void mark_value(VM& tvm, const Value& value) noexcept {
-    if (value.is_object()) { mark_object(tvm, &value.as_object()); }
+inline TX_VALUE_CONSTEXPR void
+mark_value(VM& tvm, const Value& value) noexcept {
+    mark_object(tvm, value.get_object_or_null());
 }
 
 inline constexpr void mark_table(VM& tvm, const ValueMap& table) noexcept {
@@ -186,6 +192,8 @@ inline constexpr void mark_compiler_roots(VM& tvm) noexcept {
         mark_value(tvm, tvm.parser->current.value);
         Compiler* compiler = tvm.parser->current_compiler;
         while (compiler != nullptr) {
+            // Still being written to, scan it even if old
+            remember_object(tvm, *compiler->function);
             mark_object(tvm, compiler->function);
             compiler = compiler->enclosing;
         }
@@ -223,8 +231,8 @@ inline constexpr void blacken_object(VM& tvm, Obj* obj) noexcept {
         case CLOSURE: {
             auto& closure = obj->as<ObjClosure>();
             mark_object(tvm, &closure.function);
-            for (const auto& upvalue : closure.upvalues) {
-                mark_object(tvm, upvalue);
+            for (const auto& upvalue : closure.get_upvalues()) {
+                mark_value(tvm, upvalue);
             }
             break;
         }
@@ -235,8 +243,9 @@ inline constexpr void blacken_object(VM& tvm, Obj* obj) noexcept {
             break;
         }
         case UPVALUE: mark_value(tvm, obj->as<ObjUpvalue>().closed); break;
-        case NATIVE:
-        case STRING: break;
+        case NATIVE: mark_object(tvm, obj->as<ObjNative>().name); break;
+        case STRING:
+        case INT: break;
     }
 }
 
@@ -248,9 +257,18 @@ inline constexpr void trace_references(VM& tvm) noexcept {
     }
 }
 
-inline constexpr void sweep(VM& tvm) noexcept {
+inline constexpr void trace_remembered_set(VM& tvm) noexcept {
+    for (auto* object : tvm.remembered_set) {
+        object->is_remembered = false;
+        if (tvm.is_minor_gc) { blacken_object(tvm, object); }
+    }
+    tvm.remembered_set.clear();
+}
+
+// Free unmarked objects of the list and unmark the others
+inline constexpr void sweep_list(VM& tvm, gsl::owner<Obj*>& list) noexcept {
     Obj* previous = nullptr;
-    Obj* object = tvm.objects;
+    Obj* object = list;
     while (object != nullptr) {
         if (object->is_marked) {
             object->is_marked = false;
@@ -262,7 +280,7 @@ inline constexpr void sweep(VM& tvm) noexcept {
             if (previous != nullptr) {
                 previous->next_object = unreached->next_object;
             } else {
-                tvm.objects = unreached->next_object;
+                list = unreached->next_object;
             }
             unreached->next_object = nullptr;
             free_object(tvm, unreached);
@@ -270,26 +288,66 @@ inline constexpr void sweep(VM& tvm) noexcept {
     }
 }
 
-inline constexpr void
-table_remove_white(VM& /*tvm*/, ValueMap& table) noexcept {
+inline constexpr void sweep(VM& tvm) noexcept {
+    if (!tvm.is_minor_gc) { sweep_list(tvm, tvm.old_objects); }
+    sweep_list(tvm, tvm.objects);
+    if (tvm.get_options().gc_mode != GCMode::GENERATIONAL) { return; }
+    // Promote survivors to the old generation
+    if (tvm.objects == nullptr) { return; }
+    Obj* last = tvm.objects;
+    while (true) {
+        last->is_old = true;
+        if (last->next_object == nullptr) { break; }
+        last = last->next_object;
+    }
+    last->next_object = tvm.old_objects;
+    tvm.old_objects = tvm.objects;
+    tvm.objects = nullptr;
+}
+
+inline constexpr void table_remove_white(VM& tvm, ValueMap& table) noexcept {
     for (auto& entry : table) {
-        if (!entry.first.as_object().is_marked) { table.erase(entry.first); }
+        const auto& object = entry.first.as_object();
+        if (!object.is_marked && !(tvm.is_minor_gc && object.is_old)) {
+            table.erase(entry.first);
+        }
     }
 }
 
-inline constexpr void collect_garbage(VM& tvm) noexcept {
+inline constexpr void
+collect_garbage(VM& tvm, bool is_major) noexcept {
+    std::chrono::steady_clock::time_point start;
     if constexpr (HAS_DEBUG_FEATURES) {
         if (tvm.get_options().trace_gc) {
-            fmt::print(FMT_STRING("-- GC begin\n"));
+            fmt::print(
+                FMT_STRING("-- GC begin ({:s})\n"),
+                is_major ? "major" : "minor"
+            );
+            start = std::chrono::steady_clock::now();
         }
     }
+    if (tvm.profiler != nullptr) { tvm.profiler->enter_gc(); }
     auto before = tvm.bytes_allocated;
+    tvm.is_minor_gc = !is_major;
+    tvm.minors_since_major = is_major ? 0 : tvm.minors_since_major + 1;
+    ++(is_major ? tvm.major_gc_count : tvm.minor_gc_count);
     mark_roots(tvm);
+    trace_remembered_set(tvm);
     trace_references(tvm);
     table_remove_white(tvm, tvm.strings);
     sweep(tvm);
+    tvm.is_minor_gc = false;
+    tvm.bytes_after_gc = tvm.bytes_allocated;
+    if (tvm.profiler != nullptr) { tvm.profiler->leave_gc(); }
     if constexpr (HAS_DEBUG_FEATURES) {
         if (tvm.get_options().trace_gc) {
+            const auto pause = std::chrono::steady_clock::now() - start;
+            (is_major ? tvm.major_gc_pauses : tvm.minor_gc_pauses)
+                .push_back(
+                    tvm,
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(pause)
+                        .count()
+                );
             fmt::print(
                 FMT_STRING(
                     "-- GC end\n"
@@ -304,4 +362,72 @@ inline constexpr void collect_garbage(VM& tvm) noexcept {
     }
 }
 
+// Kept out of line, inlining the collector into every allocation site bloats
+// the code
+[[gnu::noinline]] inline constexpr void
+collect_garbage_out_of_line(VM& tvm, bool is_major) noexcept {
+    collect_garbage(tvm, is_major);
+}
+
+inline constexpr void maybe_collect_garbage(VM& tvm) noexcept {
+    const auto& options = tvm.get_options();
+    const bool is_generational = options.gc_mode == GCMode::GENERATIONAL;
+    bool is_major = true;
+    if constexpr (IS_DEBUG_BUILD) {
+        // Collect as often as possible to find bugs early
+        is_major = !is_generational
+                   || tvm.minors_since_major >= DEBUG_MINOR_GC_PER_MAJOR;
+    } else {
+        if (tvm.bytes_allocated > tvm.next_gc) {
+            if (!is_generational) {
+                tvm.next_gc *= options.gc_heap_grow_factor;
+            }
+        } else if (is_generational
+                   && tvm.bytes_allocated - tvm.bytes_after_gc
+                          > options.gc_nursery_size) {
+            is_major = false;
+        } else {
+            return;
+        }
+    }
+    collect_garbage_out_of_line(tvm, is_major);
+    if (!IS_DEBUG_BUILD && is_generational && is_major) {
+        tvm.next_gc = std::max<size_t>(
+            START_GC,
+            tvm.bytes_allocated * options.gc_heap_grow_factor
+        );
+    }
+}
+
+inline void print_gc_pauses(
+    std::string_view name,
+    DynArray<i64, size_t, false>& pauses
+) noexcept {
+    if (pauses.empty()) { return; }
+    std::sort(pauses.begin(), pauses.end());
+    // Nearest rank percentile, in microseconds
+    const auto percentile = [&](size_t pct) {
+        const auto rank = std::max(size_t{1}, (pct * pauses.size() + 99) / 100);
+        return static_cast<double>(pauses[rank - 1]) / 1000.0;
+    };
+    fmt::print(
+        FMT_STRING(
+            "   {:s}: {:d} pauses, p50 {:.1f}us, p90 {:.1f}us, "
+            "p99 {:.1f}us, max {:.1f}us\n"
+        ),
+        name,
+        pauses.size(),
+        percentile(50),
+        percentile(90),
+        percentile(99),
+        percentile(100)
+    );
+}
+
+inline void print_gc_pauses(VM& tvm) noexcept {
+    fmt::print(FMT_STRING("-- GC pause times\n"));
+    print_gc_pauses("minor", tvm.minor_gc_pauses);
+    print_gc_pauses("major", tvm.major_gc_pauses);
+}
+
 }  // namespace tx
@@ -13,10 +13,13 @@
 #include <type_traits>
 #include <cassert>
 #include <optional>
+#include <memory>
+#include <span>
 
 namespace tx {
 
 class VM;
+struct JitCode;
 
 struct Obj {
     enum class ObjType : u8 {
@@ -25,10 +28,15 @@ struct Obj {
         NATIVE,
         STRING,
         UPVALUE,
+        INT,
     };
 
     ObjType type;
     bool is_marked = false;
+    // Generational GC, survived a collection and is in the old generation
+    bool is_old = false;
+    // Generational GC, old object in the remembered set
+    bool is_remembered = false;
     gsl::owner<Obj*> next_object = nullptr;
 
     Obj() = delete;
@@ -80,6 +88,9 @@ struct Obj {
     // noexcept;
 };
 
+inline constexpr std::size_t OBJ_TYPE_COUNT =
+    to_underlying(Obj::ObjType::INT) + 1U;
+
 template <typename T, typename... Args>
 T* allocate_object(VM& tvm, Args&&... args) noexcept;
 
@@ -153,6 +164,10 @@ struct ObjFunction : Obj {
     Chunk chunk;
     ObjString* name{nullptr};
     std::string_view module_file_path;
+    // Native code, once the function is hot, see jit.hxx
+    JitCode* jit_code{nullptr};
+    // Calls and loop iterations until then
+    size_t hotness{0};
 
     constexpr explicit ObjFunction(
         size_t reserved_slots,
@@ -180,6 +195,18 @@ struct ObjFunction : Obj {
     }
 };
 
+// Only used with NaN boxing, for integers that do not fit in a Value
+struct ObjInt : Obj {
+    int_t value;
+
+    constexpr explicit ObjInt(int_t val) noexcept
+            : Obj(ObjType::INT)
+            , value(val) {}
+};
+
+// Integer value, boxed on the heap if it does not fit in a Value
+[[nodiscard]] Value make_int(VM& tvm, int_t val) noexcept;
+
 struct ObjUpvalue : Obj {
     Value* location;
     Value closed{val_none};
@@ -192,14 +219,46 @@ struct ObjUpvalue : Obj {
 
 struct ObjClosure : Obj {
     ObjFunction& function;
-    DynArray<ObjUpvalue*> upvalues;
+    size_t upvalue_count;
 
-    constexpr explicit ObjClosure(VM& tvm, ObjFunction& fun) noexcept
+    // Stored in the same allocation. Each upvalue is either the ObjUpvalue of
+    // a variable captured by reference, or the value of a variable captured
+    // by copy, as the variable is never written after it is captured.
+    // clang-format off
+    #ifdef __clang__
+    #pragma clang diagnostic push
+    #pragma clang diagnostic ignored "-Wc99-extensions"
+    #endif
+    // NOLINTNEXTLINE(*-c-arrays)
+    __extension__ Value upvalues[];
+    #ifdef __clang__
+    #pragma clang diagnostic pop
+    #endif
+    // clang-format on
+
+    explicit ObjClosure(ObjFunction& fun) noexcept
             : Obj(ObjType::CLOSURE)
             , function(fun)
-            , upvalues(tvm, fun.upvalue_count, nullptr) {}
+            , upvalue_count(fun.upvalue_count) {
+        std::uninitialized_fill_n(&upvalues[0], upvalue_count, Value{val_none});
+    }
+
+    ObjClosure(const ObjClosure& other) = delete;
+    ObjClosure(ObjClosure&& other) = delete;
+
+    constexpr ~ObjClosure() noexcept = default;
 
-    constexpr void destroy(VM& tvm) noexcept { upvalues.destroy(tvm); }
+    constexpr ObjClosure* operator=(const ObjClosure& rhs) noexcept = delete;
+    constexpr ObjClosure* operator=(ObjClosure&& rhs) noexcept = delete;
+
+    [[nodiscard]] constexpr std::span<Value> get_upvalues() noexcept {
+        return {&upvalues[0], static_cast<std::size_t>(upvalue_count)};
+    }
+
+    [[nodiscard]] constexpr std::span<const Value> get_upvalues(
+    ) const noexcept {
+        return {&upvalues[0], static_cast<std::size_t>(upvalue_count)};
+    }
 };
 
 [[nodiscard]] ObjClosure* make_closure(VM& tvm, ObjFunction& fun) noexcept;
@@ -234,10 +293,12 @@ using NativeFn = NativeResult (*)(VM& tvm, NativeInOut inout);
 
 struct ObjNative : Obj {
     NativeFn function{nullptr};
+    ObjString* name{nullptr};
 
-    constexpr explicit ObjNative(NativeFn fun) noexcept
+    constexpr explicit ObjNative(NativeFn fun, ObjString& nam) noexcept
             : Obj{ObjType::NATIVE}
-            , function(fun) {}
+            , function(fun)
+            , name(&nam) {}
 };
 
 }  // namespace tx
@@ -3,6 +3,7 @@
 #include "tx/hash.hxx"
 #include "tx/object.hxx"
 #include "tx/memory.hxx"
+#include "tx/program.hxx"
 #include "tx/utils.hxx"
 #include "tx/vm.hxx"
 #include <type_traits>
@@ -57,6 +58,10 @@ T* allocate_object_extra_size(VM& tvm, size_t extra, Args&&... args) noexcept {
     object_ptr = std::construct_at<T>(object_ptr, std::forward<Args>(args)...);
     object_ptr->next_object = tvm.objects;
     tvm.objects = object_ptr;
+    auto& stats = tvm.object_stats[to_underlying(object_ptr->type)];
+    ++stats.count;
+    ++stats.allocation_count;
+    stats.bytes += static_cast<size_t>(sizeof(T)) + extra;
     if constexpr (HAS_DEBUG_FEATURES) {
         if (tvm.get_options().trace_gc) {
             fmt::print(
@@ -81,12 +86,30 @@ T* allocate_object(VM& tvm, Args&&... args) noexcept {
 }
 
 inline ObjClosure* make_closure(VM& tvm, ObjFunction& fun) noexcept {
-    return allocate_object<ObjClosure>(tvm, tvm, fun);
+    return allocate_object_extra_size<ObjClosure>(
+        tvm,
+        fun.upvalue_count * size_cast(sizeof(Value)),
+        fun
+    );
+}
+
+inline Value make_int([[maybe_unused]] VM& tvm, int_t val) noexcept {
+#ifdef TX_ENABLE_NAN_BOXING
+    if (!Value::fits_inline(val)) [[unlikely]] {
+        return Value{allocate_object<ObjInt>(tvm, val)};
+    }
+#endif
+    return Value{val};
 }
 
 inline ObjString*
 make_string(VM& tvm, bool copy, std::string_view strv) noexcept {
     auto hash = Hash<std::string_view>()(strv);
+    // Strings of the program are shared, never intern a copy of them
+    if (tvm.program != nullptr) {
+        auto* shared = tvm.program->find_string(strv, hash);
+        if (shared != nullptr) { return shared; }
+    }
     auto* interned = tvm.strings.find_in_bucket(hash, [&](const auto& entry) {
         const auto& str = entry.first.as_object().template as<ObjString>();
         return str.hash == hash && std::string_view(str) == strv;
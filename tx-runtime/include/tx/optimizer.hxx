@@ -0,0 +1,15 @@
+#pragma once
+
+#include "tx/chunk.hxx"
+
+namespace tx {
+
+class VM;
+
+// Optional optimization pass run on the bytecode of each compiled function.
+// Folds constant expressions, removes dead push/pop pairs and fuses common
+// instruction sequences into superinstructions. Jump offsets and line
+// information are recomputed.
+void optimize_chunk(VM& tvm, Chunk& chunk) noexcept;
+
+}  // namespace tx
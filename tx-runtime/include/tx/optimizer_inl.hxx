@@ -0,0 +1,571 @@
+#pragma once
+
+#include "tx/optimizer.hxx"
+//
+#include "tx/chunk.hxx"
+#include "tx/common.hxx"
+#include "tx/dyn_array.hxx"
+#include "tx/memory.hxx"
+#include "tx/object.hxx"
+#include "tx/value.hxx"
+#include "tx/vm.hxx"
+
+#include <array>
+#include <bit>
+#include <limits>
+#include <optional>
+
+namespace tx {
+
+// Decoded instruction, operands of jumps are replaced by the index of the
+// target instruction so that instructions can be added or removed freely.
+inline constexpr size_t NO_INDEX = std::numeric_limits<size_t>::max();
+
+struct OptInstruction {
+    static constexpr bool IS_TRIVIALLY_RELOCATABLE = true;
+
+    OpCode opcode;
+    std::array<u8, 3> operands{};
+    size_t line = 0;
+    size_t target = NO_INDEX;
+    // Closures have a variable length, they are copied as is from the source
+    size_t source_offset = NO_INDEX;
+    size_t source_length = 0;
+    bool is_jump_target = false;
+
+    [[nodiscard]] constexpr size_t get_operand() const noexcept {
+        u32 result = 0;
+        for (u32 i = 0; i < get_byte_count_following_opcode(opcode); ++i) {
+            result += static_cast<u32>(gsl::at(operands, i)) << (i * 8U);
+        }
+        return size_cast(result);
+    }
+
+    [[nodiscard]] constexpr size_t get_length() const noexcept {
+        if (source_length > 0) { return source_length; }
+        return 1 + get_byte_count_following_opcode(opcode);
+    }
+};
+
+using OptInstructionArray = DynArray<OptInstruction>;
+using IndexArray = DynArray<size_t>;
+
+[[nodiscard]] inline constexpr bool is_jump(OpCode opc) noexcept {
+    using enum OpCode;
+    return opc == JUMP || opc == JUMP_IF_FALSE || opc == LOOP
+           || opc == LESS_INT_JUMP_IF_FALSE;
+}
+
+// Instructions that push a value without any other side effect
+[[nodiscard]] inline constexpr bool is_pure_push(OpCode opc) noexcept {
+    switch (opc) {
+        using enum OpCode;
+        case CONSTANT:
+        case CONSTANT_LONG:
+        case NIL:
+        case TRUE:
+        case FALSE:
+        case GET_LOCAL:
+        case GET_LOCAL_LONG:
+        case GET_UPVALUE:
+        case GET_UPVALUE_LONG:
+        case GET_UPVALUE_COPY:
+        case GET_UPVALUE_COPY_LONG: return true;
+        default: return false;
+    }
+}
+
+inline void mark_jump_targets(OptInstructionArray& instructions) noexcept {
+    for (auto& instr : instructions) { instr.is_jump_target = false; }
+    for (const auto& instr : instructions) {
+        if (is_jump(instr.opcode) && instr.target < instructions.size()) {
+            instructions[instr.target].is_jump_target = true;
+        }
+    }
+}
+
+inline void remap_jump_targets(
+    OptInstructionArray& instructions,
+    const IndexArray& remap
+) noexcept {
+    for (auto& instr : instructions) {
+        if (is_jump(instr.opcode)) { instr.target = remap[instr.target]; }
+    }
+    mark_jump_targets(instructions);
+}
+
+[[nodiscard]] inline OptInstructionArray
+decode_chunk(VM& tvm, const Chunk& chunk) noexcept {
+    OptInstructionArray result;
+    IndexArray offset_to_index(tvm, chunk.code.size() + 1, NO_INDEX);
+    size_t offset = 0;
+    while (offset < chunk.code.size()) {
+        const auto* ptr = std::next(chunk.code.cbegin(), offset);
+        OptInstruction instr{
+            .opcode = ptr->as_opcode(),
+            .line = chunk.get_line(offset),
+            .source_offset = offset};
+        const auto operand_count = get_byte_count_following_opcode(
+            instr.opcode
+        );
+        for (size_t i = 0; i < operand_count; ++i) {
+            gsl::at(instr.operands, i) = std::next(ptr, 1 + i)->as_u8();
+        }
+        if (instr.opcode == OpCode::CLOSURE
+            || instr.opcode == OpCode::CLOSURE_LONG) {
+            const auto& function = chunk.constants[instr.get_operand()]
+                                       .as_object()
+                                       .as<ObjFunction>();
+            size_t length = 1 + operand_count;
+            for (size_t i = 0; i < function.upvalue_count; ++i) {
+                const auto [is_local, is_value, index, len] =
+                    read_closure_operand(std::next(ptr, length));
+                length += len;
+            }
+            instr.source_length = length;
+        }
+        offset_to_index[offset] = result.size();
+        offset += instr.get_length();
+        result.push_back(tvm, instr);
+    }
+    offset_to_index[offset] = result.size();
+    for (auto& instr : result) {
+        if (!is_jump(instr.opcode)) { continue; }
+        const auto end = instr.source_offset + instr.get_length();
+        const auto jump = instr.get_operand();
+        const auto target = (instr.opcode == OpCode::LOOP) ? end - jump
+                                                           : end + jump;
+        instr.target = offset_to_index[target];
+        assert(instr.target != NO_INDEX);
+    }
+    offset_to_index.destroy(tvm);
+    mark_jump_targets(result);
+    return result;
+}
+
+inline void encode_chunk(
+    VM& tvm,
+    Chunk& chunk,
+    const OptInstructionArray& instructions
+) noexcept {
+    IndexArray offsets(tvm, instructions.size() + 1, 0);
+    size_t offset = 0;
+    for (size_t i = 0; i < instructions.size(); ++i) {
+        offsets[i] = offset;
+        offset += instructions[i].get_length();
+    }
+    offsets[instructions.size()] = offset;
+    ByteCodeArray code;
+    LineStartArray lines;
+    code.reserve(tvm, offset);
+    for (size_t i = 0; i < instructions.size(); ++i) {
+        const auto& instr = instructions[i];
+        if (lines.empty() || lines.back().line != instr.line) {
+            lines.emplace_back(tvm, code.size(), instr.line);
+        }
+        if (instr.source_length > 0) {
+            for (size_t j = 0; j < instr.source_length; ++j) {
+                code.push_back(tvm, chunk.code[instr.source_offset + j]);
+            }
+            continue;
+        }
+        code.emplace_back(tvm, instr.opcode);
+        if (is_jump(instr.opcode)) {
+            const auto end = offsets[i] + instr.get_length();
+            const auto jump = (instr.opcode == OpCode::LOOP)
+                                  ? end - offsets[instr.target]
+                                  : offsets[instr.target] - end;
+            assert(jump <= std::numeric_limits<u16>::max());
+            // NOLINTNEXTLINE(*-magic-numbers)
+            code.emplace_back(tvm, static_cast<u8>(jump & 0xff));
+            // NOLINTNEXTLINE(*-magic-numbers)
+            code.emplace_back(tvm, static_cast<u8>(jump >> 8));
+            continue;
+        }
+        const auto operand_count = get_byte_count_following_opcode(
+            instr.opcode
+        );
+        for (size_t j = 0; j < operand_count; ++j) {
+            code.emplace_back(tvm, gsl::at(instr.operands, j));
+        }
+    }
+    offsets.destroy(tvm);
+    chunk.code.destroy(tvm);
+    chunk.code = std::move(code);
+    chunk.lines.destroy(tvm);
+    chunk.lines = std::move(lines);
+}
+
+[[nodiscard]] inline std::optional<Value>
+get_constant(const Chunk& chunk, const OptInstruction& instr) noexcept {
+    switch (instr.opcode) {
+        using enum OpCode;
+        case CONSTANT:
+        case CONSTANT_LONG: return chunk.constants[instr.get_operand()];
+        case NIL: return Value{val_nil};
+        case TRUE: return Value{true};
+        case FALSE: return Value{false};
+        default: return std::nullopt;
+    }
+}
+
+[[nodiscard]] inline bool
+is_same_constant(const Value& lhs, const Value& rhs) noexcept {
+    if (lhs.get_type() != rhs.get_type()) { return false; }
+    // Do not merge 0.0 and -0.0
+    if (lhs.is_float()) {
+        return std::bit_cast<u64>(lhs.as_float())
+               == std::bit_cast<u64>(rhs.as_float());
+    }
+    return lhs == rhs;
+}
+
+[[nodiscard]] inline std::optional<OptInstruction> make_constant_instruction(
+    Chunk& chunk,
+    Value value,
+    size_t line
+) noexcept {
+    if (value.is_nil()) {
+        return OptInstruction{.opcode = OpCode::NIL, .line = line};
+    }
+    if (value.is_bool()) {
+        return OptInstruction{
+            .opcode = value.as_bool() ? OpCode::TRUE : OpCode::FALSE,
+            .line = line};
+    }
+    const auto* existing = std::ranges::find_if(
+        chunk.constants,
+        [&](const auto& constant) { return is_same_constant(constant, value); }
+    );
+    size_t idx = std::distance(chunk.constants.cbegin(), existing);
+    if (existing == chunk.constants.cend()) {
+        if (idx >= size_cast(1U << 24U)) { return std::nullopt; }
+        // Capacity was reserved before the value was created
+        chunk.constants.push_back_unsafe(value);
+    }
+    const bool is_long = idx >= size_cast(1U << 8U);
+    OptInstruction instr{
+        .opcode = is_long ? OpCode::CONSTANT_LONG : OpCode::CONSTANT,
+        .line = line};
+    for (u32 i = 0; i < (is_long ? 3U : 1U); ++i) {
+        gsl::at(instr.operands, i) = static_cast<u8>(
+            (static_cast<u32>(idx) >> (i * 8U)) & 0xffU
+        );
+    }
+    return instr;
+}
+
+enum class FoldOp {
+    EQUAL,
+    NOT_EQUAL,
+    GREATER,
+    GREATER_EQUAL,
+    LESS,
+    LESS_EQUAL,
+    ADD,
+    SUBSTRACT,
+    MULTIPLY,
+    DIVIDE,
+};
+
+struct FoldInfo {
+    FoldOp operation;
+    bool is_float;
+};
+
+[[nodiscard]] inline constexpr std::optional<FoldInfo>
+get_fold_info(OpCode opc) noexcept {
+    switch (opc) {
+        using enum OpCode;
+        case EQUAL:
+        case EQUAL_INT:
+        case EQUAL_STRING: return FoldInfo{FoldOp::EQUAL, false};
+        case NOT_EQUAL:
+        case NOT_EQUAL_INT:
+        case NOT_EQUAL_STRING: return FoldInfo{FoldOp::NOT_EQUAL, false};
+        case GREATER:
+        case GREATER_INT: return FoldInfo{FoldOp::GREATER, false};
+        case GREATER_EQUAL:
+        case GREATER_EQUAL_INT: return FoldInfo{FoldOp::GREATER_EQUAL, false};
+        case LESS:
+        case LESS_INT: return FoldInfo{FoldOp::LESS, false};
+        case LESS_EQUAL:
+        case LESS_EQUAL_INT: return FoldInfo{FoldOp::LESS_EQUAL, false};
+        case ADD:
+        case ADD_INT: return FoldInfo{FoldOp::ADD, false};
+        case SUBSTRACT:
+        case SUBSTRACT_INT: return FoldInfo{FoldOp::SUBSTRACT, false};
+        case MULTIPLY:
+        case MULTIPLY_INT: return FoldInfo{FoldOp::MULTIPLY, false};
+        case DIVIDE:
+        case DIVIDE_INT: return FoldInfo{FoldOp::DIVIDE, false};
+        case GREATER_FLOAT: return FoldInfo{FoldOp::GREATER, true};
+        case GREATER_EQUAL_FLOAT: return FoldInfo{FoldOp::GREATER_EQUAL, true};
+        case LESS_FLOAT: return FoldInfo{FoldOp::LESS, true};
+        case LESS_EQUAL_FLOAT: return FoldInfo{FoldOp::LESS_EQUAL, true};
+        case ADD_FLOAT: return FoldInfo{FoldOp::ADD, true};
+        case SUBSTRACT_FLOAT: return FoldInfo{FoldOp::SUBSTRACT, true};
+        case MULTIPLY_FLOAT: return FoldInfo{FoldOp::MULTIPLY, true};
+        case DIVIDE_FLOAT: return FoldInfo{FoldOp::DIVIDE, true};
+        default: return std::nullopt;
+    }
+}
+
+template <typename T>
+[[nodiscard]] inline constexpr std::optional<bool>
+fold_comparison(FoldOp operation, T lhs, T rhs) noexcept {
+    switch (operation) {
+        using enum FoldOp;
+        case GREATER: return lhs > rhs;
+        case GREATER_EQUAL: return lhs >= rhs;
+        case LESS: return lhs < rhs;
+        case LESS_EQUAL: return lhs <= rhs;
+        default: return std::nullopt;
+    }
+}
+
+// Returns nothing when the operation would overflow or divide by zero, the
+// error (or lack of) is left to the runtime
+[[nodiscard]] inline constexpr std::optional<int_t>
+fold_int_arithmetic(FoldOp operation, int_t lhs, int_t rhs) noexcept {
+    int_t result = 0;
+    switch (operation) {
+        using enum FoldOp;
+        case ADD:
+            if (__builtin_add_overflow(lhs, rhs, &result)) { break; }
+            return result;
+        case SUBSTRACT:
+            if (__builtin_sub_overflow(lhs, rhs, &result)) { break; }
+            return result;
+        case MULTIPLY:
+            if (__builtin_mul_overflow(lhs, rhs, &result)) { break; }
+            return result;
+        case DIVIDE:
+            if (rhs == 0
+                || (lhs == std::numeric_limits<int_t>::min() && rhs == -1)) {
+                break;
+            }
+            return lhs / rhs;
+        default: break;
+    }
+    return std::nullopt;
+}
+
+[[nodiscard]] inline constexpr std::optional<float_t>
+fold_float_arithmetic(FoldOp operation, float_t lhs, float_t rhs) noexcept {
+    switch (operation) {
+        using enum FoldOp;
+        case ADD: return lhs + rhs;
+        case SUBSTRACT: return lhs - rhs;
+        case MULTIPLY: return lhs * rhs;
+        case DIVIDE: return lhs / rhs;
+        default: return std::nullopt;
+    }
+}
+
+// Same semantic as the corresponding instructions in VM::run()
+[[nodiscard]] inline std::optional<Value>
+fold_binary(VM& tvm, FoldInfo info, Value lhs, Value rhs) noexcept {
+    if (info.operation == FoldOp::EQUAL) { return Value{lhs == rhs}; }
+    if (info.operation == FoldOp::NOT_EQUAL) { return Value{lhs != rhs}; }
+    if (!lhs.is_number() || !rhs.is_number()) { return std::nullopt; }
+    if (!info.is_float && lhs.is_int() && rhs.is_int()) {
+        if (auto res = fold_comparison(info.operation, lhs.as_int(), rhs.as_int())) {
+            return Value{*res};
+        }
+        if (auto res = fold_int_arithmetic(
+                info.operation,
+                lhs.as_int(),
+                rhs.as_int()
+            )) {
+            return make_int(tvm, *res);
+        }
+        return std::nullopt;
+    }
+    const auto left = lhs.as_float_force();
+    const auto right = rhs.as_float_force();
+    if (auto res = fold_comparison(info.operation, left, right)) {
+        return Value{*res};
+    }
+    if (auto res = fold_float_arithmetic(info.operation, left, right)) {
+        return Value{*res};
+    }
+    return std::nullopt;
+}
+
+[[nodiscard]] inline std::optional<Value>
+fold_unary(VM& tvm, OpCode opc, Value value) noexcept {
+    if (opc == OpCode::NOT) { return Value{value.is_falsey()}; }
+    if (opc != OpCode::NEGATE) { return std::nullopt; }
+    if (value.is_float()) { return Value{-value.as_float()}; }
+    if (value.is_int() && value.as_int() != std::numeric_limits<int_t>::min()) {
+        return make_int(tvm, -value.as_int());
+    }
+    return std::nullopt;
+}
+
+// Folding may create a new constant, make sure it can be added to the chunk
+// without an allocation so that it can not be collected in between
+inline void reserve_constant(VM& tvm, Chunk& chunk) noexcept {
+    if (chunk.constants.size() == chunk.constants.capacity()) {
+        chunk.constants.reserve(
+            tvm,
+            grow_capacity(chunk.constants.capacity())
+        );
+    }
+}
+
+inline void replace_tail(
+    OptInstructionArray& output,
+    size_t count,
+    const OptInstruction& instr
+) noexcept {
+    for (size_t i = 0; i < count; ++i) { output.pop_back(); }
+    output.push_back_unsafe(instr);
+}
+
+// Try to simplify the end of the output after an instruction was appended.
+// Returns true if the removed instructions included a jump target that must
+// be transfered to the next instruction.
+[[nodiscard]] inline bool
+fold_tail(VM& tvm, Chunk& chunk, OptInstructionArray& output) noexcept {
+    const auto count = output.size();
+    if (count < 2 || output.back().is_jump_target) { return false; }
+    const auto last = output[count - 1];
+    const auto previous = output[count - 2];
+    // Dead push/pop pair
+    if (last.opcode == OpCode::POP && is_pure_push(previous.opcode)) {
+        output.pop_back();
+        output.pop_back();
+        return previous.is_jump_target;
+    }
+    const auto fold_info = get_fold_info(last.opcode);
+    if (fold_info.has_value()) {
+        if (count < 3 || previous.is_jump_target) { return false; }
+        const auto first = output[count - 3];
+        const auto lhs = get_constant(chunk, first);
+        const auto rhs = get_constant(chunk, previous);
+        if (!lhs.has_value() || !rhs.has_value()) { return false; }
+        reserve_constant(tvm, chunk);
+        const auto result = fold_binary(tvm, *fold_info, *lhs, *rhs);
+        if (!result.has_value()) { return false; }
+        auto instr = make_constant_instruction(chunk, *result, last.line);
+        if (!instr.has_value()) { return false; }
+        instr->is_jump_target = first.is_jump_target;
+        replace_tail(output, 3, *instr);
+        return false;
+    }
+    if (last.opcode != OpCode::NOT && last.opcode != OpCode::NEGATE) {
+        return false;
+    }
+    const auto operand = get_constant(chunk, previous);
+    if (!operand.has_value()) { return false; }
+    reserve_constant(tvm, chunk);
+    const auto result = fold_unary(tvm, last.opcode, *operand);
+    if (!result.has_value()) { return false; }
+    auto instr = make_constant_instruction(chunk, *result, last.line);
+    if (!instr.has_value()) { return false; }
+    instr->is_jump_target = previous.is_jump_target;
+    replace_tail(output, 2, *instr);
+    return false;
+}
+
+// Constant folding and dead push/pop removal
+[[nodiscard]] inline OptInstructionArray fold_constants(
+    VM& tvm,
+    Chunk& chunk,
+    const OptInstructionArray& input
+) noexcept {
+    OptInstructionArray output;
+    IndexArray remap(tvm, input.size() + 1, 0);
+    bool carry_target = false;
+    for (size_t i = 0; i < input.size(); ++i) {
+        remap[i] = output.size();
+        output.push_back(tvm, input[i]);
+        output.back().is_jump_target |= carry_target;
+        carry_target = fold_tail(tvm, chunk, output);
+    }
+    remap[input.size()] = output.size();
+    remap_jump_targets(output, remap);
+    remap.destroy(tvm);
+    return output;
+}
+
+[[nodiscard]] inline std::optional<OptInstruction> fuse_instructions(
+    const OptInstructionArray& input,
+    size_t idx,
+    size_t& fused_count
+) noexcept {
+    using enum OpCode;
+    const auto& first = input[idx];
+    const auto available = input.size() - idx;
+    const auto next_is_target = [&](size_t count) {
+        for (size_t i = 1; i < count; ++i) {
+            if (input[idx + i].is_jump_target) { return true; }
+        }
+        return false;
+    };
+    if (available >= 3 && first.opcode == GET_LOCAL
+        && input[idx + 1].opcode == CONSTANT && !next_is_target(3)) {
+        const auto third = input[idx + 2].opcode;
+        if (third == ADD_INT || third == SUBSTRACT_INT) {
+            fused_count = 3;
+            return OptInstruction{
+                .opcode = (third == ADD_INT)
+                              ? GET_LOCAL_CONSTANT_ADD_INT
+                              : GET_LOCAL_CONSTANT_SUBSTRACT_INT,
+                .operands = {first.operands[0], input[idx + 1].operands[0], 0},
+                .line = first.line};
+        }
+    }
+    if (available >= 2 && !next_is_target(2)) {
+        const auto& second = input[idx + 1];
+        if (first.opcode == LESS_INT && second.opcode == JUMP_IF_FALSE) {
+            fused_count = 2;
+            return OptInstruction{
+                .opcode = LESS_INT_JUMP_IF_FALSE,
+                .line = first.line,
+                .target = second.target};
+        }
+        if (first.opcode == GET_LOCAL && second.opcode == GET_LOCAL) {
+            fused_count = 2;
+            return OptInstruction{
+                .opcode = GET_LOCAL_GET_LOCAL,
+                .operands = {first.operands[0], second.operands[0], 0},
+                .line = first.line};
+        }
+    }
+    return std::nullopt;
+}
+
+// Superinstructions
+[[nodiscard]] inline OptInstructionArray
+fuse_superinstructions(VM& tvm, const OptInstructionArray& input) noexcept {
+    OptInstructionArray output;
+    IndexArray remap(tvm, input.size() + 1, 0);
+    for (size_t i = 0; i < input.size();) {
+        size_t fused_count = 1;
+        auto fused = fuse_instructions(input, i, fused_count);
+        for (size_t j = 0; j < fused_count; ++j) {
+            remap[i + j] = output.size();
+        }
+        output.push_back(tvm, fused.has_value() ? *fused : input[i]);
+        i += fused_count;
+    }
+    remap[input.size()] = output.size();
+    remap_jump_targets(output, remap);
+    remap.destroy(tvm);
+    return output;
+}
+
+inline void optimize_chunk(VM& tvm, Chunk& chunk) noexcept {
+    auto decoded = decode_chunk(tvm, chunk);
+    auto folded = fold_constants(tvm, chunk, decoded);
+    decoded.destroy(tvm);
+    auto fused = fuse_superinstructions(tvm, folded);
+    folded.destroy(tvm);
+    encode_chunk(tvm, chunk, fused);
+    fused.destroy(tvm);
+}
+
+}  // namespace tx
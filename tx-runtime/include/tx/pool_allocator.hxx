@@ -0,0 +1,247 @@
+#pragma once
+
+#include "tx/common.hxx"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <memory_resource>
+
+namespace tx {
+
+using Allocator = std::pmr::polymorphic_allocator<std::byte>;
+
+struct AllocatorStats {
+    // Number of blocks allocated and freed since the creation of the VM
+    size_t allocation_count{0};
+    size_t free_count{0};
+    // Number of reallocations that did not need to move the block
+    size_t in_place_count{0};
+    // Bytes requested by the live blocks
+    size_t used_bytes{0};
+    // Bytes obtained from the system, pages and large blocks
+    size_t reserved_bytes{0};
+
+    // Ratio of reserved bytes not used by live blocks
+    [[nodiscard]] constexpr double fragmentation() const noexcept {
+        if (reserved_bytes == 0) { return 0.0; }
+        return 1.0
+               - static_cast<double>(used_bytes)
+                     / static_cast<double>(reserved_bytes);
+    }
+};
+
+// VM owned allocator
+//
+// Small blocks are served from segregated size classes. Each size class
+// carves fixed size blocks out of its own pages with a bump pointer and
+// recycles the freed blocks through a free list. Pages are obtained from the
+// upstream allocator and only given back when the allocator is destroyed.
+// Large blocks are forwarded to the upstream allocator, or to the C heap
+// when the upstream is the default heap so that growing arrays can be
+// extended in place.
+class PoolAllocator {
+  public:
+    static constexpr size_t GRANULE = 16;
+    static constexpr size_t SIZE_CLASS_COUNT = 16;
+    static constexpr size_t MAX_SMALL_SIZE = GRANULE * SIZE_CLASS_COUNT;
+    static constexpr size_t PAGE_SIZE = size_t{16} * 1024;
+    static constexpr size_t C_HEAP_ALIGNMENT = alignof(std::max_align_t);
+
+  private:
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    // Header at the start of each page, blocks follow
+    struct alignas(GRANULE) Page {
+        Page* next;
+    };
+
+    struct SizeClass {
+        FreeBlock* free_list = nullptr;
+        std::byte* bump = nullptr;
+        std::byte* bump_end = nullptr;
+    };
+
+    Allocator upstream;
+    bool use_c_heap;
+    std::array<SizeClass, SIZE_CLASS_COUNT> size_classes{};
+    Page* pages = nullptr;
+    AllocatorStats stats{};
+
+    [[nodiscard]] static constexpr bool
+    is_small(size_t size, size_t alignment) noexcept {
+        return size <= MAX_SMALL_SIZE && alignment <= GRANULE;
+    }
+
+    [[nodiscard]] static constexpr size_t size_class_of(size_t size) noexcept {
+        assert(size > 0);
+        return (size - 1) / GRANULE;
+    }
+
+    [[nodiscard]] static constexpr size_t block_size(size_t size_class
+    ) noexcept {
+        return (size_class + 1) * GRANULE;
+    }
+
+    [[nodiscard]] void* allocate_small(size_t size_class) noexcept {
+        auto& szc = size_classes[static_cast<std::size_t>(size_class)];
+        if (szc.free_list != nullptr) {
+            auto* block = szc.free_list;
+            szc.free_list = block->next;
+            return block;
+        }
+        const auto size = block_size(size_class);
+        if (szc.bump_end - szc.bump < size) {
+            auto* page = static_cast<Page*>(upstream.allocate_bytes(
+                static_cast<std::size_t>(PAGE_SIZE),
+                alignof(Page)
+            ));
+            page->next = pages;
+            pages = page;
+            stats.reserved_bytes += PAGE_SIZE;
+            szc.bump = reinterpret_cast<std::byte*>(page) + sizeof(Page);
+            szc.bump_end = reinterpret_cast<std::byte*>(page) + PAGE_SIZE;
+        }
+        auto* block = szc.bump;
+        szc.bump += size;
+        return block;
+    }
+
+    void deallocate_small(void* pointer, size_t size_class) noexcept {
+        auto& szc = size_classes[static_cast<std::size_t>(size_class)];
+        auto* block = static_cast<FreeBlock*>(pointer);
+        block->next = szc.free_list;
+        szc.free_list = block;
+    }
+
+    [[nodiscard]] void* allocate_large(size_t size, size_t alignment) noexcept {
+        stats.reserved_bytes += size;
+        if (use_c_heap && alignment <= C_HEAP_ALIGNMENT) {
+            return std::malloc(static_cast<std::size_t>(size));
+        }
+        return upstream.allocate_bytes(
+            static_cast<std::size_t>(size),
+            static_cast<std::size_t>(alignment)
+        );
+    }
+
+    void
+    deallocate_large(void* pointer, size_t size, size_t alignment) noexcept {
+        stats.reserved_bytes -= size;
+        if (use_c_heap && alignment <= C_HEAP_ALIGNMENT) {
+            std::free(pointer);  // NOLINT(*-no-malloc,*-owning-memory)
+            return;
+        }
+        upstream.deallocate_bytes(
+            pointer,
+            static_cast<std::size_t>(size),
+            static_cast<std::size_t>(alignment)
+        );
+    }
+
+  public:
+    explicit PoolAllocator(const Allocator& alloc) noexcept
+            : upstream(alloc)
+            , use_c_heap(
+                  alloc.resource()->is_equal(*std::pmr::new_delete_resource())
+              ) {}
+
+    PoolAllocator(const PoolAllocator& other) = delete;
+    PoolAllocator(PoolAllocator&& other) = delete;
+
+    constexpr ~PoolAllocator() noexcept {
+        while (pages != nullptr) {
+            auto* next = pages->next;
+            upstream.deallocate_bytes(
+                pages,
+                static_cast<std::size_t>(PAGE_SIZE),
+                alignof(Page)
+            );
+            pages = next;
+        }
+    }
+
+    PoolAllocator& operator=(const PoolAllocator& rhs) = delete;
+    PoolAllocator& operator=(PoolAllocator&& rhs) = delete;
+
+    [[nodiscard]] Allocator get_upstream() const noexcept { return upstream; }
+
+    [[nodiscard]] constexpr const AllocatorStats& get_stats() const noexcept {
+        return stats;
+    }
+
+    [[nodiscard]] void* allocate(size_t size, size_t alignment) noexcept {
+        assert(size > 0);
+        ++stats.allocation_count;
+        stats.used_bytes += size;
+        if (is_small(size, alignment)) {
+            return allocate_small(size_class_of(size));
+        }
+        return allocate_large(size, alignment);
+    }
+
+    void deallocate(void* pointer, size_t size, size_t alignment) noexcept {
+        if (pointer == nullptr) { return; }
+        assert(size > 0);
+        ++stats.free_count;
+        stats.used_bytes -= size;
+        if (is_small(size, alignment)) {
+            deallocate_small(pointer, size_class_of(size));
+            return;
+        }
+        deallocate_large(pointer, size, alignment);
+    }
+
+    // Kept out of line so it is not flattened into the interpreter loop
+    [[nodiscard, gnu::noinline]] void* reallocate(
+        void* pointer,
+        size_t old_size,
+        size_t new_size,
+        size_t alignment
+    ) noexcept {
+        if (pointer == nullptr) {
+            return new_size == 0 ? nullptr : allocate(new_size, alignment);
+        }
+        if (new_size == 0) {
+            deallocate(pointer, old_size, alignment);
+            return nullptr;
+        }
+        const bool old_is_small = is_small(old_size, alignment);
+        const bool new_is_small = is_small(new_size, alignment);
+        // Still fits in its block
+        if (old_is_small && new_is_small
+            && size_class_of(old_size) == size_class_of(new_size)) {
+            ++stats.in_place_count;
+            stats.used_bytes += new_size - old_size;
+            return pointer;
+        }
+        // Let the C heap extend the block if there is room after it
+        if (!old_is_small && !new_is_small && use_c_heap
+            && alignment <= C_HEAP_ALIGNMENT) {
+            // NOLINTNEXTLINE(*-no-malloc,*-owning-memory)
+            void* result =
+                std::realloc(pointer, static_cast<std::size_t>(new_size));
+            if (result == nullptr) { return nullptr; }
+            if (result == pointer) { ++stats.in_place_count; }
+            stats.used_bytes += new_size - old_size;
+            stats.reserved_bytes += new_size - old_size;
+            return result;
+        }
+        void* result = allocate(new_size, alignment);
+        if (result == nullptr) { return nullptr; }
+        std::memcpy(
+            result,
+            pointer,
+            static_cast<std::size_t>(std::min(old_size, new_size))
+        );
+        deallocate(pointer, old_size, alignment);
+        return result;
+    }
+};
+
+}  // namespace tx
@@ -0,0 +1,197 @@
+#pragma once
+
+#include "tx/chunk.hxx"
+#include "tx/common.hxx"
+#include "tx/dyn_array.hxx"
+#include "tx/hash_map.hxx"
+
+#include <fmt/format.h>
+
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <limits>
+#include <string_view>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace tx {
+
+class VM;
+struct Obj;
+struct ObjFunction;
+struct ObjNative;
+
+// Execution profiler
+//
+// When a profiler is set on the VM, the interpreter loop and the call paths
+// are instantiated with profiling hooks, otherwise the hooks are compiled
+// out. It collects the execution count of each opcode, and the call count
+// and inclusive/exclusive cycles of each function, native and of the garbage
+// collector, along the whole call tree. Reading the cycle counter around
+// every instruction would dominate their cost, so the cycles of opcodes are
+// estimated from randomly sampled instructions. Reports are a summary table
+// and folded stacks for flamegraph tools.
+//
+// Its data is allocated by the VM without triggering collections, as the
+// hooks run during them. The profiler has to be destroyed before the VM.
+class Profiler {
+  public:
+    using Cycles = u64;
+
+    static constexpr std::size_t OPCODE_COUNT = opcode_length_table.size();
+
+    // Time stamp counter when available, nanoseconds otherwise
+    [[nodiscard]] static Cycles read_cycles() noexcept {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return static_cast<Cycles>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()
+            )
+                .count()
+        );
+#endif
+    }
+
+  private:
+    // Function, native or GC
+    struct Entry {
+        static constexpr bool IS_TRIVIALLY_RELOCATABLE = true;
+
+        // In names
+        size_t name_offset{0};
+        size_t name_size{0};
+        u64 calls{0};
+        Cycles inclusive{0};
+        Cycles exclusive{0};
+        // Frames of this entry on the stack, to not count recursive calls
+        // twice in the inclusive cycles
+        size_t active{0};
+        bool is_native{false};
+    };
+
+    // Node of the call tree
+    struct Node {
+        static constexpr bool IS_TRIVIALLY_RELOCATABLE = true;
+
+        size_t parent;
+        size_t entry;
+        Cycles exclusive{0};
+    };
+
+    struct Frame {
+        static constexpr bool IS_TRIVIALLY_RELOCATABLE = true;
+
+        size_t node;
+        Cycles start;
+        Cycles children{0};
+    };
+
+    static constexpr size_t ROOT_NODE = 0;
+    static constexpr size_t GC_ENTRY = 0;
+    static constexpr size_t NO_INDEX = std::numeric_limits<size_t>::max();
+    static constexpr size_t TOMBSTONE_INDEX = NO_INDEX - 1;
+    static constexpr u64 NO_NODE_KEY = std::numeric_limits<u64>::max();
+
+    // Functions and natives are keyed by address until they are freed
+    using EntryIndices = HashMap<
+        const Obj*,
+        size_t,
+        nullptr,
+        NO_INDEX,
+        TOMBSTONE_INDEX,
+        Hash<const Obj*>,
+        std::equal_to<const Obj*>,
+        size_t,
+        false>;
+    // Keyed by parent node and entry
+    using NodeIndices = HashMap<
+        u64,
+        size_t,
+        NO_NODE_KEY,
+        NO_INDEX,
+        TOMBSTONE_INDEX,
+        Hash<u64>,
+        std::equal_to<u64>,
+        size_t,
+        false>;
+
+    // Average distance between sampled instructions
+    static constexpr u32 SAMPLE_PERIOD = 32;
+
+    std::array<u64, OPCODE_COUNT> opcode_counts{};
+    std::array<u64, OPCODE_COUNT> opcode_samples{};
+    std::array<Cycles, OPCODE_COUNT> opcode_sampled_cycles{};
+    u32 sample_countdown{1};
+    u32 sample_random{1};
+    bool is_sampling{false};
+    OpCode sampled_opcode{OpCode::END};
+    Cycles sample_start{0};
+    Cycles native_cycles{0};
+    Cycles gc_cycles{0};
+    VM& tvm;
+    DynArray<char, size_t, false> names;
+    DynArray<Entry, size_t, false> entries;
+    EntryIndices entry_indices;
+    DynArray<Node, size_t, false> nodes;
+    NodeIndices node_indices;
+    DynArray<Frame, size_t, false> frames;
+    std::chrono::steady_clock::time_point start_time;
+    Cycles start_cycles;
+
+    template <typename... Args>
+    size_t add_entry(
+        bool is_native,
+        fmt::format_string<const Args&...> format,
+        const Args&... args
+    ) noexcept;
+    [[nodiscard]] std::string_view get_name(const Entry& entry) const noexcept;
+    [[nodiscard]] size_t get_entry(const Obj& object) noexcept;
+    [[nodiscard]] size_t get_node(size_t parent, size_t entry) noexcept;
+    void start_sample(OpCode instruction) noexcept;
+    void stop_sample() noexcept;
+    [[nodiscard]] double get_nanoseconds_per_cycle() const noexcept;
+    void enter(size_t entry) noexcept;
+    Cycles leave() noexcept;
+
+  public:
+    explicit Profiler(VM& tvm_) noexcept;
+    Profiler(const Profiler& other) = delete;
+    Profiler(Profiler&& other) = delete;
+    ~Profiler() noexcept;
+
+    Profiler& operator=(const Profiler& rhs) = delete;
+    Profiler& operator=(Profiler&& rhs) = delete;
+
+    // Interpreter loop hook, called before executing each instruction
+    void start_instruction(OpCode instruction) noexcept {
+        ++opcode_counts[to_underlying(instruction)];
+        if (is_sampling) [[unlikely]] { stop_sample(); }
+        if (--sample_countdown == 0) [[unlikely]] {
+            start_sample(instruction);
+        }
+    }
+
+    void start_run(const ObjFunction& script) noexcept;
+    // Also unwinds the frames left by a runtime error
+    void stop_run() noexcept;
+
+    void enter_function(const ObjFunction& function) noexcept;
+    void leave_function() noexcept;
+    void enter_native(const ObjNative& native) noexcept;
+    void leave_native() noexcept;
+    void enter_gc() noexcept;
+    void leave_gc() noexcept;
+
+    // Called when a function or native is freed, its address can be reused
+    void forget_object(const Obj& object) noexcept;
+
+    void write_summary(std::FILE* file) const noexcept;
+    void write_folded_stacks(std::FILE* file) const noexcept;
+};
+
+}  // namespace tx
@@ -0,0 +1,321 @@
+#pragma once
+
+#include "tx/profiler.hxx"
+
+#include "tx/debug.hxx"
+#include "tx/object.hxx"
+#include "tx/vm.hxx"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <cassert>
+#include <numeric>
+
+namespace tx {
+
+inline Profiler::Profiler(VM& tvm_) noexcept
+        : tvm(tvm_)
+        , start_time(std::chrono::steady_clock::now())
+        , start_cycles(read_cycles()) {
+    (void)add_entry(false, FMT_STRING("[gc]"));
+    nodes.push_back(tvm, Node{.parent = ROOT_NODE, .entry = GC_ENTRY});
+}
+
+inline Profiler::~Profiler() noexcept {
+    // Objects freed with the VM are not reported
+    tvm.set_profiler(nullptr);
+    names.destroy(tvm);
+    entries.destroy(tvm);
+    entry_indices.destroy(tvm);
+    nodes.destroy(tvm);
+    node_indices.destroy(tvm);
+    frames.destroy(tvm);
+}
+
+template <typename... Args>
+inline size_t Profiler::add_entry(
+    bool is_native,
+    fmt::format_string<const Args&...> format,
+    const Args&... args
+) noexcept {
+    const auto offset = names.size();
+    const auto size = size_cast(fmt::formatted_size(format, args...));
+    names.resize(tvm, offset + size);
+    fmt::format_to(std::next(names.data(), offset), format, args...);
+    entries.push_back(
+        tvm,
+        Entry{.name_offset = offset, .name_size = size, .is_native = is_native}
+    );
+    return entries.size() - 1;
+}
+
+inline std::string_view Profiler::get_name(const Entry& entry) const noexcept {
+    return {
+        std::next(names.data(), entry.name_offset),
+        static_cast<std::size_t>(entry.name_size)
+    };
+}
+
+inline size_t Profiler::get_entry(const Obj& object) noexcept {
+    if (const auto* index = entry_indices.get(&object)) { return *index; }
+    size_t index = 0;
+    if (object.type == Obj::ObjType::NATIVE) {
+        index = add_entry(
+            true,
+            FMT_STRING("[native] {:s}"),
+            std::string_view(*object.as<ObjNative>().name)
+        );
+    } else {
+        const auto& function = object.as<ObjFunction>();
+        index = add_entry(
+            false,
+            FMT_STRING("{:s}:{:s}"),
+            function.module_file_path,
+            function.get_display_name()
+        );
+    }
+    entry_indices.set(tvm, &object, index);
+    return index;
+}
+
+inline size_t Profiler::get_node(size_t parent, size_t entry) noexcept {
+    const auto key = (static_cast<u64>(parent) << 32U) | static_cast<u64>(entry);
+    if (const auto* index = node_indices.get(key)) { return *index; }
+    const auto index = nodes.size();
+    nodes.push_back(tvm, Node{.parent = parent, .entry = entry});
+    node_indices.set(tvm, key, index);
+    return index;
+}
+
+inline void Profiler::start_sample(OpCode instruction) noexcept {
+    // xorshift32, uniform period in [1, 2 * SAMPLE_PERIOD - 1]
+    sample_random ^= sample_random << 13U;
+    sample_random ^= sample_random >> 17U;
+    sample_random ^= sample_random << 5U;
+    sample_countdown = 1 + sample_random % (2 * SAMPLE_PERIOD - 1);
+    is_sampling = true;
+    sampled_opcode = instruction;
+    sample_start = read_cycles();
+}
+
+inline void Profiler::stop_sample() noexcept {
+    const auto now = read_cycles();
+    const auto opcode = to_underlying(sampled_opcode);
+    ++opcode_samples[opcode];
+    opcode_sampled_cycles[opcode] += now - sample_start;
+    is_sampling = false;
+}
+
+inline double Profiler::get_nanoseconds_per_cycle() const noexcept {
+    const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start_time
+    );
+    const auto cycles = read_cycles() - start_cycles;
+    if (cycles == 0) { return 1.0; }
+    return static_cast<double>(elapsed.count()) / static_cast<double>(cycles);
+}
+
+inline void Profiler::enter(size_t entry) noexcept {
+    auto& stats = entries[entry];
+    ++stats.calls;
+    ++stats.active;
+    const auto parent = frames.empty() ? ROOT_NODE : frames.back().node;
+    frames.push_back(tvm, Frame{.node = get_node(parent, entry), .start = 0});
+    // Read last to leave the bookkeeping out of the measure
+    frames.back().start = read_cycles();
+}
+
+inline Profiler::Cycles Profiler::leave() noexcept {
+    const auto now = read_cycles();
+    assert(!frames.empty());
+    const auto frame = frames.back();
+    frames.pop_back();
+    const auto inclusive = now - frame.start;
+    const auto exclusive = inclusive - frame.children;
+    auto& node = nodes[frame.node];
+    node.exclusive += exclusive;
+    auto& stats = entries[node.entry];
+    stats.exclusive += exclusive;
+    if (--stats.active == 0) { stats.inclusive += inclusive; }
+    if (!frames.empty()) { frames.back().children += inclusive; }
+    return inclusive;
+}
+
+inline void Profiler::start_run(const ObjFunction& script) noexcept {
+    enter_function(script);
+}
+
+inline void Profiler::stop_run() noexcept {
+    if (is_sampling) { stop_sample(); }
+    while (!frames.empty()) { (void)leave(); }
+}
+
+inline void Profiler::enter_function(const ObjFunction& function) noexcept {
+    enter(get_entry(function));
+}
+
+inline void Profiler::leave_function() noexcept { (void)leave(); }
+
+inline void Profiler::enter_native(const ObjNative& native) noexcept {
+    enter(get_entry(native));
+}
+
+inline void Profiler::leave_native() noexcept {
+    const auto cycles = leave();
+    native_cycles += cycles;
+    // Not part of the calling instruction
+    sample_start += cycles;
+}
+
+inline void Profiler::enter_gc() noexcept { enter(GC_ENTRY); }
+
+inline void Profiler::leave_gc() noexcept {
+    const auto cycles = leave();
+    gc_cycles += cycles;
+    // Not part of the allocating instruction, unless inside a native whose
+    // time is already removed as a whole
+    if (frames.empty()) {
+        sample_start += cycles;
+        return;
+    }
+    const auto& node = nodes[frames.back().node];
+    if (!entries[node.entry].is_native) {
+        sample_start += cycles;
+    }
+}
+
+inline void Profiler::forget_object(const Obj& object) noexcept {
+    (void)entry_indices.erase(&object);
+}
+
+inline void Profiler::write_summary(std::FILE* file) const noexcept {
+    const auto ns_per_cycle = get_nanoseconds_per_cycle();
+    const auto to_ms = [&](Cycles cycles) {
+        // NOLINTNEXTLINE(*-magic-numbers)
+        return static_cast<double>(cycles) * ns_per_cycle / 1'000'000.0;
+    };
+    const auto total = std::accumulate(
+        nodes.begin(),
+        nodes.end(),
+        Cycles{0},
+        [](Cycles sum, const Node& node) { return sum + node.exclusive; }
+    );
+    const auto percent = [&](Cycles cycles) {
+        if (total == 0) { return 0.0; }
+        // NOLINTNEXTLINE(*-magic-numbers)
+        return static_cast<double>(cycles) * 100.0 / static_cast<double>(total);
+    };
+    fmt::print(
+        file,
+        FMT_STRING(
+            "Profiled: {:.3f} ms ({:d} cycles)\n"
+            "Natives:  {:.3f} ms ({:.1f}%)\n"
+            "GC:       {:.3f} ms ({:.1f}%, {:d} collections)\n"
+        ),
+        to_ms(total),
+        total,
+        to_ms(native_cycles),
+        percent(native_cycles),
+        to_ms(gc_cycles),
+        percent(gc_cycles),
+        entries[GC_ENTRY].calls
+    );
+
+    DynArray<size_t, size_t, false> order(tvm, entries.size(), 0);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](auto lhs, auto rhs) {
+        return entries[lhs].exclusive > entries[rhs].exclusive;
+    });
+    fmt::print(
+        file,
+        FMT_STRING("\n{:<40s} {:>12s} {:>14s} {:>14s} {:>7s}\n"),
+        "Function",
+        "Calls",
+        "Inclusive ms",
+        "Exclusive ms",
+        "Excl. %"
+    );
+    for (const auto idx : order) {
+        const auto& entry = entries[idx];
+        if (entry.calls == 0) { continue; }
+        fmt::print(
+            file,
+            FMT_STRING("{:<40s} {:>12d} {:>14.3f} {:>14.3f} {:>7.1f}\n"),
+            get_name(entry),
+            entry.calls,
+            to_ms(entry.inclusive),
+            to_ms(entry.exclusive),
+            percent(entry.exclusive)
+        );
+    }
+
+    // Extrapolated from the samples
+    std::array<double, OPCODE_COUNT> opcode_cycles{};
+    for (std::size_t i = 0; i < OPCODE_COUNT; ++i) {
+        if (opcode_samples.at(i) == 0) { continue; }
+        opcode_cycles.at(i) = static_cast<double>(opcode_sampled_cycles.at(i))
+                              / static_cast<double>(opcode_samples.at(i))
+                              * static_cast<double>(opcode_counts.at(i));
+    }
+    std::array<std::size_t, OPCODE_COUNT> opcodes{};
+    std::iota(opcodes.begin(), opcodes.end(), 0);
+    std::sort(opcodes.begin(), opcodes.end(), [&](auto lhs, auto rhs) {
+        return opcode_cycles.at(lhs) > opcode_cycles.at(rhs);
+    });
+    const auto opcode_total =
+        std::accumulate(opcode_cycles.begin(), opcode_cycles.end(), 0.0);
+    fmt::print(
+        file,
+        FMT_STRING("\n{:<40s} {:>12s} {:>14s} {:>14s} {:>7s}\n"),
+        "Opcode",
+        "Count",
+        "Est. cycles",
+        "Cycles/op",
+        "%"
+    );
+    for (const auto idx : opcodes) {
+        const auto count = opcode_counts.at(idx);
+        if (count == 0) { continue; }
+        const auto cycles = opcode_cycles.at(idx);
+        fmt::print(
+            file,
+            FMT_STRING("{:<40s} {:>12d} {:>14.0f} {:>14.1f} {:>7.1f}\n"),
+            get_opcode_name(static_cast<OpCode>(idx)),
+            count,
+            cycles,
+            cycles / static_cast<double>(count),
+            // NOLINTNEXTLINE(*-magic-numbers)
+            opcode_total == 0.0 ? 0.0 : cycles * 100.0 / opcode_total
+        );
+    }
+    order.destroy(tvm);
+}
+
+inline void Profiler::write_folded_stacks(std::FILE* file) const noexcept {
+    const auto ns_per_cycle = get_nanoseconds_per_cycle();
+    // Entries from the leaf to the root
+    DynArray<size_t, size_t, false> path;
+    for (size_t i = 1; i < nodes.size(); ++i) {
+        const auto nanoseconds = static_cast<u64>(
+            static_cast<double>(nodes[i].exclusive) * ns_per_cycle
+        );
+        if (nanoseconds == 0) { continue; }
+        path.clear();
+        for (auto idx = i; idx != ROOT_NODE; idx = nodes[idx].parent) {
+            path.push_back(tvm, nodes[idx].entry);
+        }
+        for (auto iter = path.rbegin(); iter != path.rend(); ++iter) {
+            fmt::print(
+                file,
+                FMT_STRING("{:s}{:s}"),
+                iter == path.rbegin() ? "" : ";",
+                get_name(entries[*iter])
+            );
+        }
+        fmt::print(file, FMT_STRING(" {:d}\n"), nanoseconds);
+    }
+    path.destroy(tvm);
+}
+
+}  // namespace tx
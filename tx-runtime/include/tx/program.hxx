@@ -0,0 +1,65 @@
+#pragma once
+
+#include "tx/common.hxx"
+#include "tx/vm.hxx"
+
+#include <span>
+#include <string_view>
+
+namespace tx {
+
+struct ObjFunction;
+struct ObjString;
+
+// Compiled program, shareable by VMs running on different threads
+//
+// A program is compiled once, from source or from an image, by a VM of its
+// own. Its objects, the script, nested functions, strings and other
+// constants, are then frozen: they are never written again, and the GCs of
+// the VMs running the program see them as already marked and old, so they
+// never mark, free or remember them. Each VM running the program has its own
+// stack, globals and heap, and interns its strings with the strings of the
+// program. Sources, images and file paths the program points into, and the
+// program itself, must outlive the VMs running it.
+class Program {
+    // Not written once the program is frozen, but the lookups of its hash
+    // tables are not const
+    mutable VM tvm;
+    ObjFunction* script{nullptr};
+
+  public:
+    Program() = delete;
+    Program(VMOptions opts, const Allocator& alloc) noexcept;
+    Program(const Program& other) = delete;
+    Program(Program&& other) = delete;
+
+    ~Program() noexcept = default;
+
+    Program& operator=(const Program& rhs) = delete;
+    Program& operator=(Program&& rhs) = delete;
+
+    // Compile the script, reporting errors to stderr
+    [[nodiscard]] bool
+    compile(std::string_view file_path, std::string_view source) noexcept;
+
+    // Load the script from a precompiled image, see image.hxx
+    [[nodiscard]] bool load_image(
+        std::string_view image_path,
+        std::span<const char> image
+    ) noexcept;
+
+    [[nodiscard]] constexpr bool is_compiled() const noexcept {
+        return script != nullptr;
+    }
+
+    // Interned string of the program equal to strv, or nullptr
+    [[nodiscard]] ObjString*
+    find_string(std::string_view strv, u32 hash) const noexcept;
+
+  private:
+    void freeze(ObjFunction* function) noexcept;
+
+    friend class VM;
+};
+
+}  // namespace tx
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "tx/program.hxx"
+
+#include "tx/image.hxx"
+#include "tx/memory.hxx"
+#include "tx/object.hxx"
+
+#include <cassert>
+
+namespace tx {
+
+inline Program::Program(VMOptions opts, const Allocator& alloc) noexcept
+        : tvm(opts, alloc) {}
+
+inline bool Program::compile(
+    std::string_view file_path,
+    std::string_view source
+) noexcept {
+    assert(!is_compiled());
+    auto* function = tvm.compile(file_path, source);
+    if (function == nullptr) { return false; }
+    freeze(function);
+    return true;
+}
+
+inline bool Program::load_image(
+    std::string_view image_path,
+    std::span<const char> image
+) noexcept {
+    assert(!is_compiled());
+    auto* function = read_image(tvm, image_path, image);
+    if (function == nullptr) { return false; }
+    freeze(function);
+    return true;
+}
+
+inline ObjString*
+Program::find_string(std::string_view strv, u32 hash) const noexcept {
+    auto* interned = tvm.strings.find_in_bucket(hash, [&](const auto& entry) {
+        const auto& str = entry.first.as_object().template as<ObjString>();
+        return str.hash == hash && std::string_view(str) == strv;
+    });
+    if (interned == nullptr) { return nullptr; }
+    return &interned->first.as_object().as<ObjString>();
+}
+
+inline void Program::freeze(ObjFunction* function) noexcept {
+    // Drop the garbage of the compilation, nothing is allocated afterwards so
+    // the GC of the program never runs again
+    tvm.ensure_stack_space(1);
+    tvm.push(Value{function});
+    collect_garbage(tvm, true);
+    tvm.pop();
+    for (auto* list : {tvm.objects, tvm.old_objects}) {
+        for (Obj* object = list; object != nullptr;
+             object = object->next_object) {
+            object->is_marked = true;
+            object->is_old = true;
+        }
+    }
+    script = function;
+}
+
+}  // namespace tx
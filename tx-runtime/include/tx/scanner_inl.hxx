@@ -253,7 +253,7 @@ inline constexpr void Scanner::skip_whitespace() noexcept {
                 return error_token("Numeric literal out of range.");
             }
             auto token = make_token(type);
-            token.value = Value(value);
+            token.value = make_int(parent_vm, value);
             return token;
         }
         case FLOAT_LITERAL: {
@@ -301,7 +301,7 @@ inline constexpr void Scanner::skip_whitespace() noexcept {
         return error_token("Hexadecimal integer literal out of range.");
     }
     auto token = make_token(Token::Type::INTEGER_LITERAL);
-    token.value = Value(value);
+    token.value = make_int(parent_vm, value);
     return token;
 }
 
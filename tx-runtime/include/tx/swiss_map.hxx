@@ -0,0 +1,470 @@
+#pragma once
+
+#include "tx/hash.hxx"
+#include "tx/memory.hxx"
+#include "tx/utils.hxx"
+
+#include <gsl/util>
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace tx {
+
+// Open addressing hash map in the style of Swiss tables
+//
+// Slots are split in groups of 16. Each slot has a control byte, either
+// EMPTY or a 7 bit tag taken from the hash of its key. A lookup compares the
+// tag with the 16 control bytes of a group at once, with SSE2 when
+// available, and only compares the keys of the matching slots. Groups are
+// probed quadratically.
+//
+// Each group also has an overflow byte. An insertion that passes a full
+// group sets the bit selected by its hash, so a lookup stops at the first
+// group where that bit is not set. Erasing only empties the slot, there are
+// no tombstones. Overflow bits are cleared by rehashing, which each erasure
+// from an overflowed group brings a little closer.
+//
+// Drop-in replacement for HashMap, TOMBSTONE_VALUE is unused.
+template <
+    typename Key,
+    typename T,
+    Key EMPTY_KEY,
+    T EMPTY_VALUE,
+    T TOMBSTONE_VALUE,
+    typename Hash = Hash<Key>,
+    typename KeyEqual = std::equal_to<Key>,
+    typename SizeT = size_t,
+    bool TRIGGER_GC = true>
+class SwissMap {
+  public:
+    using Entry = std::pair<const Key, T>;
+
+    class Iterator {
+        using iterator_category = std::forward_iterator_tag;
+        using difference_type = std::ptrdiff_t;
+        using value_type = Entry;
+        using pointer = value_type*;
+        using reference = value_type&;
+
+        SwissMap* table_ptr = nullptr;
+        SwissMap::Entry* ptr = nullptr;
+
+        friend class SwissMap;
+
+        constexpr void advance() {
+            while (ptr != std::next(table_ptr->data_ptr, table_ptr->capacity)
+                   && is_entry_empty(*ptr)) {
+                ++ptr;
+            }
+        }
+
+      public:
+        constexpr Iterator(SwissMap* map, SwissMap::Entry* entry_ptr)
+                : table_ptr(map)
+                , ptr(entry_ptr) {}
+
+        [[nodiscard]] constexpr bool operator==(const Iterator& other
+        ) const noexcept {
+            return ptr == other.ptr;
+        }
+
+        [[nodiscard]] constexpr bool operator!=(const Iterator& other
+        ) const noexcept {
+            return ptr != other.ptr;
+        }
+
+        constexpr Iterator& operator++() noexcept {
+            ++ptr;
+            advance();
+            return *this;
+        }
+
+        constexpr Iterator operator++(int) noexcept {
+            Iterator tmp = *this;
+            ++(*this);
+            return tmp;
+        }
+
+        [[nodiscard]] constexpr Entry& operator*() noexcept { return *ptr; }
+
+        [[nodiscard]] constexpr Entry* operator->() noexcept { return ptr; }
+    };
+
+    class ConstIterator {
+        using iterator_category = std::forward_iterator_tag;
+        using difference_type = std::ptrdiff_t;
+        using value_type = Entry;
+        using pointer = value_type*;
+        using const_pointer = const value_type*;
+        using reference = value_type&;
+        using const_reference = const value_type&;
+
+        const SwissMap* table_ptr = nullptr;
+        const SwissMap::Entry* ptr = nullptr;
+
+        friend class SwissMap;
+
+        constexpr void advance() {
+            while (ptr != std::next(table_ptr->data_ptr, table_ptr->capacity)
+                   && is_entry_empty(*ptr)) {
+                ++ptr;
+            }
+        }
+
+      public:
+        constexpr ConstIterator(
+            const SwissMap* map,
+            const SwissMap::Entry* entry_ptr
+        )
+                : table_ptr(map)
+                , ptr(entry_ptr) {}
+
+        [[nodiscard]] constexpr bool operator==(const ConstIterator& other
+        ) const noexcept {
+            return ptr == other.ptr;
+        }
+
+        [[nodiscard]] constexpr bool operator!=(const ConstIterator& other
+        ) const noexcept {
+            return ptr != other.ptr;
+        }
+
+        constexpr ConstIterator& operator++() noexcept {
+            ++ptr;
+            advance();
+            return *this;
+        }
+
+        constexpr ConstIterator operator++(int) noexcept {
+            ConstIterator tmp = *this;
+            ++(*this);
+            return tmp;
+        }
+
+        [[nodiscard]] constexpr const Entry& operator*() const noexcept {
+            return *ptr;
+        }
+
+        [[nodiscard]] constexpr const Entry* operator->() const noexcept {
+            return ptr;
+        }
+    };
+
+    using key_type = Key;
+    using mapped_type = T;
+    using value_type = Entry;
+    using size_type = i32;
+    using difference_type = std::ptrdiff_t;
+    using iterator = Iterator;
+    using const_iterator = ConstIterator;
+    using pointer = value_type*;
+    using const_pointer = const value_type*;
+    using reference = value_type&;
+    using const_reference = const value_type&;
+
+  private:
+    static constexpr float MAX_LOAD_FACTOR = 0.875;
+    static constexpr SizeT GROUP_SIZE = 16;
+    static constexpr u8 EMPTY = 0x80;
+    static constexpr u32 TAG_BITS = 7;
+    static constexpr u32 TAG_MASK = (1U << TAG_BITS) - 1;
+    // The 3 high bits of the hash select the overflow bit
+    static constexpr u32 OVERFLOW_SHIFT = 29;
+
+    SizeT count = 0;
+    SizeT capacity = 0;
+    // Entry count triggering a rehash, lowered by erasures
+    SizeT max_count = 0;
+    gsl::owner<Entry*> data_ptr = nullptr;
+    // One control byte per slot, followed by one overflow byte per group
+    gsl::owner<u8*> control_ptr = nullptr;
+
+  public:
+    constexpr SwissMap() noexcept = default;
+    constexpr SwissMap(const SwissMap& other) noexcept = delete;
+    constexpr SwissMap(SwissMap&& other) noexcept = delete;
+
+    constexpr ~SwissMap() noexcept {
+        assert(count == 0);
+        assert(capacity == 0);
+        assert(data_ptr == nullptr);
+        assert(control_ptr == nullptr);
+    }
+
+    constexpr void destroy(VM& tvm) noexcept {
+        const auto old_capacity = capacity;
+        clear();
+        if (data_ptr != nullptr) {
+            free_array<Entry, TRIGGER_GC>(tvm, data_ptr, old_capacity);
+            free_array<u8, TRIGGER_GC>(
+                tvm,
+                control_ptr,
+                control_size(old_capacity)
+            );
+            data_ptr = nullptr;
+            control_ptr = nullptr;
+        }
+    }
+
+    constexpr SwissMap& operator=(const SwissMap& other) noexcept = delete;
+    constexpr SwissMap& operator=(SwissMap&& other) noexcept = delete;
+
+    [[nodiscard]] static constexpr float max_load_factor() noexcept {
+        return MAX_LOAD_FACTOR;
+    }
+
+    constexpr void clear() noexcept {
+        std::destroy_n(data_ptr, capacity);
+        count = 0;
+        capacity = 0;
+        max_count = 0;
+    }
+
+    [[nodiscard]] constexpr T* get(const Key& key) noexcept {
+        if (count == 0) { return nullptr; }
+        Entry* entry = find_entry(key);
+        if (entry == nullptr) { return nullptr; }
+        return &entry->second;
+    }
+
+    template <typename... Args>
+    constexpr bool set(VM& tvm, Key key, Args&&... args) noexcept {
+        assert(!KeyEqual()(key, EMPTY_KEY) && "Key cannot be the empty key.");
+        const u32 hash = Hash()(key);
+        if (count > 0) {
+            Entry* entry = find_in_bucket_impl(hash, [&key](Entry& entr) {
+                return KeyEqual()(entr.first, key);
+            });
+            if (entry != nullptr) {
+                std::destroy_at(entry);
+                std::construct_at(entry, key, std::forward<Args>(args)...);
+                return false;
+            }
+        }
+        if (count + 1 > max_count) {
+            // Only grow if the erasures did not make the room
+            const bool is_full = count + 1 > static_cast<SizeT>(
+                                     static_cast<float>(capacity)
+                                     * max_load_factor()
+                                 );
+            rehash_impl(tvm, is_full ? grow_capacity(capacity) : capacity);
+        }
+        Entry* entry = &insert_slot(hash);
+        std::destroy_at(entry);
+        std::construct_at(entry, key, std::forward<Args>(args)...);
+        return true;
+    }
+
+    constexpr bool erase(const Key& key) noexcept {
+        if (count == 0) { return false; }
+        Entry* entry = find_entry(key);
+        if (entry == nullptr) { return false; }
+        const auto index = std::distance(data_ptr, entry);
+        std::destroy_at(entry);
+        std::construct_at(entry, EMPTY_KEY, EMPTY_VALUE);
+        *std::next(control_ptr, index) = EMPTY;
+        --count;
+        if (get_overflow(index / GROUP_SIZE) != 0) { --max_count; }
+        return true;
+    }
+
+    constexpr void add_all_from(VM& tvm, const SwissMap& from) noexcept {
+        for (const auto& entry : from) { set(tvm, entry.first, entry.second); }
+    }
+
+    constexpr void rehash(VM& tvm, SizeT new_cap) noexcept {
+        rehash_impl(tvm, power_of_2_ceil(new_cap));
+    }
+
+    template <typename F>
+    [[nodiscard]] constexpr Entry* find_in_bucket(u32 hash, F func) noexcept {
+        if (count == 0) { return nullptr; }
+        return find_in_bucket_impl(hash, func);
+    }
+
+    [[nodiscard]] constexpr Iterator begin() noexcept {
+        Iterator iter(this, data_ptr);
+        iter.advance();
+        return iter;
+    }
+
+    [[nodiscard]] constexpr ConstIterator begin() const noexcept {
+        return cbegin();
+    }
+
+    [[nodiscard]] constexpr ConstIterator cbegin() const noexcept {
+        ConstIterator iter(this, data_ptr);
+        iter.advance();
+        return iter;
+    }
+
+    [[nodiscard]] constexpr Iterator end() noexcept {
+        return Iterator(this, std::next(data_ptr, capacity));
+    }
+
+    [[nodiscard]] constexpr ConstIterator end() const noexcept {
+        return cend();
+    }
+
+    [[nodiscard]] constexpr ConstIterator cend() const noexcept {
+        return ConstIterator(this, std::next(data_ptr, capacity));
+    }
+
+  private:
+    [[nodiscard]] static constexpr bool is_entry_empty(const Entry& entry
+    ) noexcept {
+        return KeyEqual()(entry.first, EMPTY_KEY);
+    }
+
+    [[nodiscard]] static constexpr SizeT control_size(SizeT cap) noexcept {
+        return cap + cap / GROUP_SIZE;
+    }
+
+    [[nodiscard]] static constexpr u8 get_tag(u32 hash) noexcept {
+        return static_cast<u8>(hash & TAG_MASK);
+    }
+
+    [[nodiscard]] static constexpr u8 get_overflow_bit(u32 hash) noexcept {
+        return static_cast<u8>(1U << (hash >> OVERFLOW_SHIFT));
+    }
+
+    [[nodiscard]] constexpr SizeT group_mask() const noexcept {
+        return capacity / GROUP_SIZE - 1;
+    }
+
+    [[nodiscard]] constexpr SizeT first_group(u32 hash) const noexcept {
+        return static_cast<SizeT>(hash >> TAG_BITS) & group_mask();
+    }
+
+    [[nodiscard]] constexpr u8& get_overflow(SizeT group) noexcept {
+        return *std::next(control_ptr, capacity + group);
+    }
+
+    // Bit i is set when the control byte of slot i of the group is equal
+    [[nodiscard]] constexpr u32 match(SizeT group, u8 control) const noexcept {
+        const u8* group_ptr = std::next(control_ptr, group * GROUP_SIZE);
+#if defined(__SSE2__)
+        if (!std::is_constant_evaluated()) {
+            const auto bytes = _mm_loadu_si128(
+                reinterpret_cast<const __m128i*>(group_ptr)
+            );
+            return static_cast<u32>(_mm_movemask_epi8(
+                _mm_cmpeq_epi8(bytes, _mm_set1_epi8(static_cast<char>(control)))
+            ));
+        }
+#endif
+        u32 mask = 0;
+        for (u32 i = 0; i < GROUP_SIZE; ++i) {
+            if (*std::next(group_ptr, i) == control) { mask |= 1U << i; }
+        }
+        return mask;
+    }
+
+    [[nodiscard]] constexpr Entry* find_entry(const Key& key) noexcept {
+        assert(!KeyEqual()(key, EMPTY_KEY) && "Key cannot be the empty key.");
+        const u32 hash = Hash()(key);
+        return find_in_bucket_impl(hash, [&key](Entry& entry) {
+            return KeyEqual()(entry.first, key);
+        });
+    }
+
+    template <typename F>
+    [[nodiscard]] constexpr Entry*
+    find_in_bucket_impl(u32 hash, F func) noexcept {
+        assert(capacity > 0);
+        assert(is_power_of_2(capacity));
+        const u8 tag = get_tag(hash);
+        const u8 overflow_bit = get_overflow_bit(hash);
+        const SizeT group_count = capacity / GROUP_SIZE;
+        SizeT group = first_group(hash);
+        for (SizeT probe = 1;; ++probe) {
+            u32 matches = match(group, tag);
+            while (matches != 0) {
+                Entry& entry = *std::next(
+                    data_ptr,
+                    group * GROUP_SIZE + std::countr_zero(matches)
+                );
+                if (std::invoke(func, entry)) { return &entry; }
+                matches &= matches - 1;
+            }
+            // Nothing inserted after this group, or all groups probed
+            if ((get_overflow(group) & overflow_bit) == 0
+                || probe == group_count) {
+                return nullptr;
+            }
+            group = (group + probe) & group_mask();
+        }
+    }
+
+    // Claim the first empty slot on the probe sequence of hash
+    [[nodiscard]] constexpr Entry& insert_slot(u32 hash) noexcept {
+        assert(count < capacity);
+        SizeT group = first_group(hash);
+        for (SizeT probe = 1;; ++probe) {
+            const u32 empties = match(group, EMPTY);
+            if (empties != 0) {
+                const auto index = group * GROUP_SIZE + std::countr_zero(empties);
+                *std::next(control_ptr, index) = get_tag(hash);
+                ++count;
+                return *std::next(data_ptr, index);
+            }
+            get_overflow(group) |= get_overflow_bit(hash);
+            group = (group + probe) & group_mask();
+        }
+    }
+
+    constexpr void rehash_impl(VM& tvm, SizeT new_cap) noexcept {
+        new_cap = std::max(new_cap, GROUP_SIZE);
+        assert(is_power_of_2(new_cap));
+        // Allocations can collect garbage, and erase from this table
+        auto* new_data_ptr = allocate<Entry, TRIGGER_GC>(tvm, new_cap);
+        auto* new_control_ptr =
+            allocate<u8, TRIGGER_GC>(tvm, control_size(new_cap));
+        std::uninitialized_fill_n(
+            new_data_ptr,
+            new_cap,
+            Entry(EMPTY_KEY, EMPTY_VALUE)
+        );
+        std::fill_n(new_control_ptr, new_cap, EMPTY);
+        std::fill_n(std::next(new_control_ptr, new_cap), new_cap / GROUP_SIZE, 0);
+        auto* old_data_ptr = data_ptr;
+        auto* old_control_ptr = control_ptr;
+        const auto old_capacity = capacity;
+        data_ptr = new_data_ptr;
+        control_ptr = new_control_ptr;
+        capacity = new_cap;
+        count = 0;
+        max_count = static_cast<SizeT>(
+            static_cast<float>(new_cap) * max_load_factor()
+        );
+        for (SizeT i = 0; i < old_capacity; ++i) {
+            Entry* src = std::next(old_data_ptr, i);
+            if (is_entry_empty(*src)) { continue; }
+            Entry* dest = &insert_slot(Hash()(src->first));
+            std::destroy_at(dest);
+            std::construct_at(dest, std::move(*src));
+        }
+        if (old_data_ptr != nullptr) {
+            std::destroy_n(old_data_ptr, old_capacity);
+            free_array<Entry, TRIGGER_GC>(tvm, old_data_ptr, old_capacity);
+            free_array<u8, TRIGGER_GC>(
+                tvm,
+                old_control_ptr,
+                control_size(old_capacity)
+            );
+        }
+    }
+};
+
+}  // namespace tx
@@ -2,17 +2,32 @@
 
 #include "tx/hash_map.hxx"
 #include "tx/hash_set.hxx"
+#include "tx/swiss_map.hxx"
 #include "tx/value.hxx"
 
 namespace tx {
 
+#ifdef TX_ENABLE_SWISS_TABLE
+using ValueMap =
+    SwissMap<Value, Value, Value{val_none}, Value{val_none}, Value{val_nil}>;
+#else
 using ValueMap =
     HashMap<Value, Value, Value{val_none}, Value{val_none}, Value{val_nil}>;
+#endif
 
 // using StringSet =
 //     HashSet<ObjString*, nullptr, Hash<ObjString*>, std::equal_to<ObjString*>
 //     >;
 
+#ifdef TX_ENABLE_SWISS_TABLE
+using ValueSet = HashSet<
+    Value,
+    Value{val_none},
+    Hash<Value>,
+    std::equal_to<Value>,
+    SwissMap>;
+#else
 using ValueSet = HashSet<Value, Value{val_none}>;
+#endif
 
 }  // namespace tx
@@ -12,9 +12,16 @@
 #include "tx/hash_map.hxx"
 #include "tx/hash_murmur.hxx"
 #include "tx/hash_set.hxx"
+#include "tx/image.hxx"
+#include "tx/jit.hxx"
 #include "tx/memory.hxx"
 #include "tx/object.hxx"
+#include "tx/optimizer.hxx"
+#include "tx/pool_allocator.hxx"
+#include "tx/profiler.hxx"
+#include "tx/program.hxx"
 #include "tx/scanner.hxx"
+#include "tx/swiss_map.hxx"
 #include "tx/table.hxx"
 #include "tx/type.hxx"
 #include "tx/type_traits.hxx"
@@ -25,8 +32,13 @@
 
 #include "tx/compiler_inl.hxx"
 #include "tx/debug_inl.hxx"
+#include "tx/image_inl.hxx"
+#include "tx/jit_inl.hxx"
 #include "tx/memory_inl.hxx"
 #include "tx/object_inl.hxx"
+#include "tx/optimizer_inl.hxx"
+#include "tx/profiler_inl.hxx"
+#include "tx/program_inl.hxx"
 #include "tx/scanner_inl.hxx"
 #include "tx/type_inl.hxx"
 #include "tx/value_inl.hxx"
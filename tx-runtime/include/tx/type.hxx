@@ -41,6 +41,9 @@ struct TypeSet {
     }
 
     [[nodiscard]] constexpr bool is_nil() const noexcept;
+    [[nodiscard]] constexpr bool is_int() const noexcept;
+    [[nodiscard]] constexpr bool is_float() const noexcept;
+    [[nodiscard]] constexpr bool is_string() const noexcept;
 
     friend constexpr bool
     operator==(const TypeSet& lhs, const TypeSet& rhs) noexcept;
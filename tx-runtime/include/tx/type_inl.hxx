@@ -146,6 +146,21 @@ TypeSet::move_all_from(VM& tvm, TypeSet&& other) noexcept {
     return types[0] == TypeInfo{TypeInfo::Type::NIL};
 }
 
+[[nodiscard]] inline constexpr bool TypeSet::is_int() const noexcept {
+    if (types.size() != 1) { return false; }
+    return types[0] == TypeInfo{TypeInfo::Type::INT};
+}
+
+[[nodiscard]] inline constexpr bool TypeSet::is_float() const noexcept {
+    if (types.size() != 1) { return false; }
+    return types[0] == TypeInfo{TypeInfo::Type::FLOAT};
+}
+
+[[nodiscard]] inline constexpr bool TypeSet::is_string() const noexcept {
+    if (types.size() != 1) { return false; }
+    return types[0] == TypeInfo{TypeInfo::Type::STRING};
+}
+
 inline constexpr bool
 operator==(const TypeSet& lhs, const TypeSet& rhs) noexcept {
     if (lhs.types.size() != rhs.types.size()) { return false; }
@@ -5,6 +5,8 @@
 #include "tx/type_traits.hxx"
 #include "tx/utils.hxx"
 
+#include <bit>
+
 namespace tx {
 
 struct Obj;
@@ -15,6 +17,204 @@ struct ValNil {};
 inline constexpr ValNone val_none;
 inline constexpr ValNil val_nil;
 
+#ifdef TX_ENABLE_NAN_BOXING
+
+struct ObjInt;
+
+// NaN boxed value, 8 bytes.
+// Floats are stored as is (NaNs are canonicalized), every other type is
+// stored as a quiet NaN with the type tag in the 16 high bits and the payload
+// in the 48 low bits. Integers that do not fit in 48 bits are boxed in an
+// ObjInt, see make_int().
+struct Value {
+    static constexpr bool IS_TRIVIALLY_RELOCATABLE = true;
+
+    enum class Type {
+        NONE,
+        NIL,
+        BOOL,
+        INT,
+        FLOAT,
+        CHAR,
+        OBJECT,
+    };
+
+    static constexpr u64 QNAN = 0x7ffc'0000'0000'0000;
+    static constexpr u64 CANONICAL_NAN = 0x7ff8'0000'0000'0000;
+    static constexpr u64 PAYLOAD_MASK = 0x0000'ffff'ffff'ffff;
+    static constexpr u32 TAG_SHIFT = 48;
+    static constexpr u64 TAG_NONE = 0x7ffc;
+    static constexpr u64 TAG_NIL = 0x7ffd;
+    static constexpr u64 TAG_BOOL = 0x7ffe;
+    static constexpr u64 TAG_CHAR = 0x7fff;
+    static constexpr u64 TAG_INT = 0xfffc;
+    static constexpr u64 TAG_BOXED_INT = 0xfffd;
+    static constexpr u64 TAG_OBJECT = 0xfffe;
+    static constexpr int_t MIN_INLINE_INT = -(int_t{1} << (TAG_SHIFT - 1));
+    static constexpr int_t MAX_INLINE_INT = (int_t{1} << (TAG_SHIFT - 1)) - 1;
+
+    u64 bits;
+
+    constexpr Value() noexcept = delete;
+
+    constexpr explicit Value(const ValNone& /*tag*/) noexcept
+            : bits(TAG_NONE << TAG_SHIFT) {}
+
+    constexpr explicit Value(const ValNil& /*tag*/) noexcept
+            : bits(TAG_NIL << TAG_SHIFT) {}
+
+    constexpr explicit Value(bool val) noexcept
+            : bits((TAG_BOOL << TAG_SHIFT) | static_cast<u64>(val)) {}
+
+    // Use make_int() for integers that might not fit inline
+    constexpr explicit Value(int_t val) noexcept
+            : bits(
+                (TAG_INT << TAG_SHIFT) | (static_cast<u64>(val) & PAYLOAD_MASK)
+            ) {
+        assert(fits_inline(val));
+    }
+
+    constexpr explicit Value(float_t val) noexcept
+            : bits(val != val ? CANONICAL_NAN : std::bit_cast<u64>(val)) {}
+
+    constexpr explicit Value(char32_t val) noexcept
+            : bits((TAG_CHAR << TAG_SHIFT) | static_cast<u64>(val)) {}
+
+    explicit Value(Obj* val) noexcept
+            : bits((TAG_OBJECT << TAG_SHIFT) | reinterpret_cast<u64>(val)) {
+        assert((reinterpret_cast<u64>(val) & ~PAYLOAD_MASK) == 0);
+    }
+
+    explicit Value(ObjInt* val) noexcept;
+
+    [[nodiscard]] static constexpr bool fits_inline(int_t val) noexcept {
+        return val >= MIN_INLINE_INT && val <= MAX_INLINE_INT;
+    }
+
+    [[nodiscard]] constexpr u64 get_tag() const noexcept {
+        return bits >> TAG_SHIFT;
+    }
+
+    [[nodiscard]] constexpr Type get_type() const noexcept {
+        if (is_float()) { return Type::FLOAT; }
+        switch (get_tag()) {
+            case TAG_NONE: return Type::NONE;
+            case TAG_NIL: return Type::NIL;
+            case TAG_BOOL: return Type::BOOL;
+            case TAG_CHAR: return Type::CHAR;
+            case TAG_INT:
+            case TAG_BOXED_INT: return Type::INT;
+            case TAG_OBJECT: return Type::OBJECT;
+            default: break;
+        }
+        unreachable();
+    }
+
+    [[nodiscard]] constexpr bool as_bool() const noexcept {
+        assert(is_bool());
+        return (bits & PAYLOAD_MASK) != 0;
+    }
+
+    [[nodiscard]] constexpr int_t as_int() const noexcept {
+        assert(is_int());
+        if (is_boxed_int()) [[unlikely]] { return as_boxed_int(); }
+        // Sign extend the 48 bits payload
+        return static_cast<int_t>(bits << (64 - TAG_SHIFT))
+               >> (64 - TAG_SHIFT);
+    }
+
+    [[nodiscard]] int_t as_boxed_int() const noexcept;
+
+    [[nodiscard]] constexpr float_t as_float() const noexcept {
+        assert(is_float());
+        return std::bit_cast<float_t>(bits);
+    }
+
+    [[nodiscard]] constexpr float_t as_float_force() const noexcept {
+        assert(is_int() || is_float());
+        return is_float() ? as_float() : static_cast<float_t>(as_int());
+    }
+
+    [[nodiscard]] constexpr char32_t as_char() const noexcept {
+        assert(is_char());
+        return static_cast<char32_t>(bits & PAYLOAD_MASK);
+    }
+
+    [[nodiscard]] Obj& as_object() const noexcept {
+        assert(is_object());
+        // NOLINTNEXTLINE(*-reinterpret-cast,performance-no-int-to-ptr)
+        return *reinterpret_cast<Obj*>(bits & PAYLOAD_MASK);
+    }
+
+    // Any heap object referenced by this value, for the GC
+    [[nodiscard]] Obj* get_object_or_null() const noexcept {
+        if (!is_object() && !is_boxed_int()) { return nullptr; }
+        // NOLINTNEXTLINE(*-reinterpret-cast,performance-no-int-to-ptr)
+        return reinterpret_cast<Obj*>(bits & PAYLOAD_MASK);
+    }
+
+    [[nodiscard]] constexpr bool is_none() const noexcept {
+        return get_tag() == TAG_NONE;
+    }
+
+    [[nodiscard]] constexpr bool is_nil() const noexcept {
+        return get_tag() == TAG_NIL;
+    }
+
+    [[nodiscard]] constexpr bool is_bool() const noexcept {
+        return get_tag() == TAG_BOOL;
+    }
+
+    [[nodiscard]] constexpr bool is_int() const noexcept {
+        // TAG_INT and TAG_BOXED_INT only differ by their lowest bit
+        return (get_tag() >> 1U) == (TAG_INT >> 1U);
+    }
+
+    [[nodiscard]] constexpr bool is_boxed_int() const noexcept {
+        return get_tag() == TAG_BOXED_INT;
+    }
+
+    [[nodiscard]] constexpr bool is_float() const noexcept {
+        return (bits & QNAN) != QNAN;
+    }
+
+    [[nodiscard]] constexpr bool is_number() const noexcept {
+        return is_float() || is_int();
+    }
+
+    [[nodiscard]] constexpr bool is_char() const noexcept {
+        return get_tag() == TAG_CHAR;
+    }
+
+    [[nodiscard]] constexpr bool is_object() const noexcept {
+        return get_tag() == TAG_OBJECT;
+    }
+
+    [[nodiscard]] constexpr bool is_falsey() const noexcept {
+        return is_nil() || bits == (TAG_BOOL << TAG_SHIFT);
+    }
+
+    friend constexpr std::partial_ordering
+    operator<=>(const Value& lhs, const Value& rhs) noexcept;
+
+    [[nodiscard]] friend constexpr bool
+    operator==(const Value& lhs, const Value& rhs) noexcept {
+        // Different bits can still be equal floats (0.0 and -0.0) and the
+        // same bits can be different floats (NaN)
+        if (lhs.is_float() && rhs.is_float()) {
+            return lhs.as_float() == rhs.as_float();
+        }
+        if (lhs.is_boxed_int() && rhs.is_boxed_int()) [[unlikely]] {
+            return lhs.as_int() == rhs.as_int();
+        }
+        return lhs.bits == rhs.bits;
+    }
+};
+
+static_assert(sizeof(Value) == 8);
+
+#else
+
 struct Value {
     static constexpr bool IS_TRIVIALLY_RELOCATABLE = true;
 
@@ -65,6 +265,8 @@ struct Value {
             : type(Type::OBJECT)
             , as{.obj = val} {}
 
+    [[nodiscard]] constexpr Type get_type() const noexcept { return type; }
+
     [[nodiscard]] constexpr bool as_bool() const noexcept {
         assert(is_bool());
         // NOLINTNEXTLINE(*-union-access)
@@ -100,6 +302,12 @@ struct Value {
         return *as.obj;
     }
 
+    // Any heap object referenced by this value, for the GC
+    [[nodiscard]] constexpr Obj* get_object_or_null() const noexcept {
+        // NOLINTNEXTLINE(*-union-access)
+        return is_object() ? as.obj : nullptr;
+    }
+
     [[nodiscard]] constexpr bool is_none() const noexcept {
         return type == Type::NONE;
     }
@@ -156,6 +364,8 @@ struct Value {
     }
 };
 
+#endif
+
 using ValueArray = DynArray<Value>;
 // using ConstValueArray = DynArray<const Value>;
 
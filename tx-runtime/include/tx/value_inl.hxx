@@ -10,8 +10,10 @@ namespace tx {
 
 [[nodiscard]] constexpr std::partial_ordering
 operator<=>(const Value& lhs, const Value& rhs) noexcept {
-    if (lhs.type != rhs.type) { return std::partial_ordering::unordered; }
-    switch (lhs.type) {
+    if (lhs.get_type() != rhs.get_type()) {
+        return std::partial_ordering::unordered;
+    }
+    switch (lhs.get_type()) {
         using enum Value::Type;
         case NONE:
         case NIL: return std::strong_ordering::equal;
@@ -24,4 +26,25 @@ operator<=>(const Value& lhs, const Value& rhs) noexcept {
     unreachable();
 }
 
+#ifdef TX_ENABLE_NAN_BOXING
+
+inline Value::Value(ObjInt* val) noexcept
+        : bits(
+            (TAG_BOXED_INT << TAG_SHIFT)
+            | reinterpret_cast<u64>(static_cast<Obj*>(val))
+        ) {
+    assert((reinterpret_cast<u64>(static_cast<Obj*>(val)) & ~PAYLOAD_MASK) == 0
+    );
+}
+
+[[nodiscard]] inline int_t Value::as_boxed_int() const noexcept {
+    assert(is_boxed_int());
+    // NOLINTNEXTLINE(*-reinterpret-cast,performance-no-int-to-ptr)
+    return reinterpret_cast<const Obj*>(bits & PAYLOAD_MASK)
+        ->as<ObjInt>()
+        .value;
+}
+
+#endif
+
 }  // namespace tx
@@ -4,10 +4,16 @@
 #include "tx/common.hxx"
 #include "tx/compiler.hxx"
 #include "tx/fixed_array.hxx"
+#include "tx/jit.hxx"
+#include "tx/pool_allocator.hxx"
+#include "tx/profiler.hxx"
 
 #include "tx/table.hxx"
 #include <fmt/core.h>
+#include <array>
+#include <cstdio>
 #include <memory_resource>
+#include <span>
 #include <string_view>
 
 namespace tx {
@@ -18,11 +24,37 @@ enum class InterpretResult {
     RUNTIME_ERROR,
 };
 
+enum class GCMode {
+    // Stop the world mark & sweep of the whole heap
+    FULL,
+    // Frequent collections of the objects allocated since the previous
+    // collection, and full collections when the heap has grown enough
+    GENERATIONAL,
+};
+
+enum class JitMode {
+    // Interpret everything
+    OFF,
+    // Compile functions to native code once they are hot
+    HOT,
+    // Compile every function on its first call, to test the JIT
+    FORCE,
+};
+
 struct VMOptions {
     bool trace_execution = false;
     bool print_tokens = false;
     bool print_bytecode = false;
     bool trace_gc = false;
+    bool optimize = false;
+    // Standard output of the scripts, nullptr for stdout
+    std::FILE* output = nullptr;
+    // Garbage collector
+    GCMode gc_mode = GCMode::GENERATIONAL;
+    size_t gc_nursery_size = GC_NURSERY_SIZE;
+    size_t gc_heap_grow_factor = GC_HEAP_GROW_FACTOR;
+    // Native code tier, only in builds with a JIT
+    JitMode jit_mode = JitMode::HOT;
     // REPL specific options
     bool allow_pointer_to_source_content = true;
     bool allow_global_redefinition = false;
@@ -60,25 +92,50 @@ struct CallFrame {
         return closure.function.chunk.constants[size_cast(constant_idx)];
     }
 
-    [[nodiscard]] constexpr std::tuple<bool, size_t> read_closure_operand(
-    ) noexcept;
+    [[nodiscard]] constexpr std::tuple<bool, bool, size_t>
+    read_closure_operand() noexcept;
 
     void print_instruction() const noexcept;
 };
 
 class Parser;
+class Program;
+struct JitHelpers;
+class JitCompiler;
+
+struct ObjectStats {
+    // Live objects
+    size_t count{0};
+    size_t bytes{0};
+    // Objects allocated since the creation of the VM
+    size_t allocation_count{0};
+};
 
-using Allocator = std::pmr::polymorphic_allocator<std::byte>;
+struct MemoryStats {
+    // Bytes of objects and of the arrays they own, drives the GC
+    size_t bytes_allocated{0};
+    // Heap size triggering the next major collection
+    size_t next_gc{0};
+    size_t minor_gc_count{0};
+    size_t major_gc_count{0};
+    // Indexed by Obj::ObjType
+    std::array<ObjectStats, OBJ_TYPE_COUNT> objects{};
+    AllocatorStats allocator{};
+};
 
 class VM {
     using CallFrames = DynArray<CallFrame>;
     using Stack = DynArray<Value>;
     using GlobalArray = DynArray<Global>;
     using GrayStack = DynArray<Obj*, size_t, false>;
+    using GCPauseArray = DynArray<i64, size_t, false>;
 
     VMOptions options{};
-    Allocator allocator{};
+    PoolAllocator allocator;
     Parser* parser{nullptr};
+    Profiler* profiler{nullptr};
+    // Shared program the VM runs, if any
+    const Program* program{nullptr};
     CallFrames frames{};
     Stack stack;
     ValueArray global_values;
@@ -86,8 +143,27 @@ class VM {
     ObjUpvalue* open_upvalues{nullptr};
     size_t bytes_allocated{0};
     size_t next_gc{START_GC};
+    // Young objects, all objects when not using the generational GC
     gsl::owner<Obj*> objects = nullptr;
+    gsl::owner<Obj*> old_objects = nullptr;
     GrayStack gray_stack;
+    // Old objects that may reference young objects
+    GrayStack remembered_set;
+    size_t bytes_after_gc{0};
+    size_t minors_since_major{0};
+    size_t minor_gc_count{0};
+    size_t major_gc_count{0};
+    bool is_minor_gc{false};
+    std::array<ObjectStats, OBJ_TYPE_COUNT> object_stats{};
+    GCPauseArray minor_gc_pauses;
+    GCPauseArray major_gc_pauses;
+    // Calls and loop iterations after which a function is compiled to native
+    // code, 0 when the JIT is disabled
+    size_t jit_threshold{0};
+    // Last instruction seen by assert_stack_effect() in debug builds
+    size_t previous_stack_size{0};
+    OpCode previous_opcode{OpCode::END};
+    size_t previous_operand{0};
 
     // Only strictly needed by the parser,
     // but need to persist for REPL and error messages
@@ -97,6 +173,8 @@ class VM {
   public:
     VM() = delete;
     VM(VMOptions opts, const Allocator& alloc) noexcept;
+    // VM running a shared program, see program.hxx
+    VM(VMOptions opts, const Allocator& alloc, const Program& prog) noexcept;
     VM(const VM& other) = delete;
     VM(VM&& other) = delete;
 
@@ -106,7 +184,11 @@ class VM {
     VM& operator=(VM&& rhs) = delete;
 
     // constexpr
-    [[nodiscard]] Allocator get_allocator() const { return allocator; }
+    [[nodiscard]] Allocator get_allocator() const {
+        return allocator.get_upstream();
+    }
+
+    [[nodiscard]] constexpr MemoryStats get_memory_stats() const noexcept;
 
     [[nodiscard]] constexpr const VMOptions& get_options() const noexcept {
         return options;
@@ -123,10 +205,29 @@ class VM {
     inline ObjFunction*
     compile(std::string_view file_path, std::string_view source) noexcept;
 
+    // Run a precompiled image, see image.hxx
+    InterpretResult interpret_image(
+        std::string_view image_path,
+        std::span<const char> image
+    ) noexcept;
+
+    // Run the program the VM was created with
+    InterpretResult interpret_program() noexcept;
+
+    // Profile the following executions, nullptr to stop profiling
+    constexpr void set_profiler(Profiler* prof) noexcept { profiler = prof; }
+
     // TX_VM_CONSTEXPR
-    [[gnu::flatten]] InterpretResult run() noexcept;
+    InterpretResult run() noexcept;
 
   private:
+    VM(VMOptions opts, const Allocator& alloc, const Program* prog) noexcept;
+
+    template <bool PROFILE>
+    [[gnu::flatten]] InterpretResult run_loop() noexcept;
+
+    InterpretResult run_script(ObjFunction& function) noexcept;
+
     constexpr void push(Value value) noexcept {
         assert(stack.capacity() > stack.size());
         stack.push_back_unsafe(value);
@@ -157,8 +258,8 @@ class VM {
     }
 
     void print_stack() const noexcept;
-    void assert_stack_effect(const ByteCode* iptr) const noexcept;
-    void debug_trace(const ByteCode* iptr) const noexcept;
+    void assert_stack_effect(const ByteCode* iptr) noexcept;
+    void debug_trace(const ByteCode* iptr) noexcept;
 
     constexpr size_t
     add_global(Value name, Global&& signature, Value val) noexcept;
@@ -174,27 +275,61 @@ class VM {
 
     void constexpr ensure_stack_space(size_t needed) noexcept;
 
+    void grow_stack(size_t needed) noexcept;
+
+    template <bool PROFILE = false>
     [[nodiscard]] constexpr bool
     call(ObjClosure& closure, size_t arg_c) noexcept;
 
+    // Arity already checked by the compiler
+    template <bool PROFILE = false>
     [[nodiscard]] constexpr bool
+    call_closure(ObjClosure& closure, size_t arg_c) noexcept;
+
+    template <bool PROFILE = false>
+    [[nodiscard]] bool call_native(ObjNative& native, size_t arg_c) noexcept;
+
+    template <bool PROFILE = false>
+    [[nodiscard]] TX_VALUE_CONSTEXPR bool
     call_value(Value callee, size_t arg_c) noexcept;
 
+    // Push the global function called by CALL_GLOBAL below its arguments,
+    // nullptr if it is not defined
+    [[nodiscard]] ObjClosure*
+    push_global_callee(size_t index, size_t arg_c) noexcept;
+
+    // Call replacing the frame of the caller when the callee is a closure
+    template <bool PROFILE = false>
+    [[nodiscard, gnu::noinline]] bool
+    tail_call(Value callee, size_t arg_c) noexcept;
+
     [[nodiscard]] ObjUpvalue& capture_upvalue(Value* local) noexcept;
 
     constexpr void close_upvalues(const Value* last) noexcept;
 
     [[nodiscard]] constexpr bool negate_op() noexcept;
 
+    template <typename T>
+    [[nodiscard]] constexpr Value make_number_result(T val) noexcept;
+
     template <template <typename> typename Op>
     [[nodiscard]] constexpr bool binary_op() noexcept;
 
+    template <template <typename> typename Op>
+    constexpr void binary_op_int() noexcept;
+
+    template <template <typename> typename Op>
+    constexpr void binary_op_float() noexcept;
+
     template <u8 N>
     inline void do_constant(CallFrame*& frame) noexcept;
 
     template <u8 N>
     inline void do_get_local(CallFrame*& frame) noexcept;
 
+    template <template <typename> typename Op>
+    inline void do_local_constant_op_int(CallFrame*& frame) noexcept;
+
     template <u8 N>
     inline void do_set_local(CallFrame*& frame) noexcept;
 
@@ -214,18 +349,39 @@ class VM {
     inline void do_set_upvalue(CallFrame*& frame) noexcept;
 
     template <u8 N>
-    inline void do_closure(CallFrame*& frame) noexcept;
+    inline void do_get_upvalue_copy(CallFrame*& frame) noexcept;
+
+    // Kept out of line, flattened into run_loop the allocation and captures
+    // slow down the dispatch of every other instruction
+    template <u8 N>
+    [[gnu::noinline]] void do_closure(CallFrame*& frame) noexcept;
 
     template <u8 N>
     inline void do_end_scope(CallFrame*& frame) noexcept;
 
+    // Whether to run the function of the frame as native code, counting the
+    // call or loop iteration towards the threshold when COUNT
+    template <bool COUNT>
+    [[nodiscard]] constexpr bool is_jit_entry(CallFrame& frame) noexcept;
+
+    // Compile the function of the frame if needed and run it until the first
+    // instruction left to the interpreter
+    void run_jit(CallFrame*& frame) noexcept;
+
     // Friends
     friend constexpr void mark_roots(VM& tvm) noexcept;
     friend constexpr void mark_compiler_roots(VM& tvm) noexcept;
     friend constexpr void mark_object(VM& tvm, Obj* obj) noexcept;
     friend constexpr void trace_references(VM& tvm) noexcept;
+    friend constexpr void trace_remembered_set(VM& tvm) noexcept;
     friend constexpr void sweep(VM& tvm) noexcept;
-    friend constexpr void collect_garbage(VM& tvm) noexcept;
+    friend constexpr void
+    table_remove_white(VM& tvm, ValueMap& table) noexcept;
+    friend constexpr void collect_garbage(VM& tvm, bool is_major) noexcept;
+    friend constexpr void maybe_collect_garbage(VM& tvm) noexcept;
+    friend constexpr void remember_object(VM& tvm, Obj& obj) noexcept;
+    friend void free_object(VM& tvm, Obj* object) noexcept;
+    friend void print_gc_pauses(VM& tvm) noexcept;
 
     template <bool TRIGGER_GC>
     // constexpr
@@ -244,7 +400,15 @@ class VM {
     friend ObjString*
     make_string(VM& tvm, bool copy, std::string_view strv) noexcept;
 
+    friend void
+    jit_run(VM& tvm, const JitCode& code, CallFrame& frame) noexcept;
+
     friend class Parser;
+    friend class Program;
+    friend struct JitHelpers;
+    friend class JitCompiler;
+    friend class ImageReader;
+    friend class ImageWriter;
 };
 
 }  // namespace tx
@@ -8,7 +8,10 @@
 #include "tx/compiler.hxx"
 #include "tx/debug.hxx"
 #include "tx/formatting.hxx"
+#include "tx/image.hxx"
+#include "tx/jit.hxx"
 #include "tx/object.hxx"
+#include "tx/program.hxx"
 #include "tx/utils.hxx"
 #include "tx/value.hxx"
 
@@ -84,11 +87,11 @@ inline NativeResult core_assert_native(VM& /*tvm*/, NativeInOut inout) {
     return NativeResult::SUCCESS;
 }
 
-inline NativeResult std_cpu_clock_read_native(VM& /*tvm*/, NativeInOut inout) {
+inline NativeResult std_cpu_clock_read_native(VM& tvm, NativeInOut inout) {
     const auto args = inout.args();
     assert(args.empty());
     (void)args;
-    inout.return_value() = Value{std::clock()};
+    inout.return_value() = make_int(tvm, std::clock());
     return NativeResult::SUCCESS;
 }
 
@@ -109,14 +112,14 @@ using DurationFloat = std::chrono::duration<float_t>;
 using TimePoint =
     std::chrono::time_point<std::chrono::high_resolution_clock, DurationInt>;
 
-inline NativeResult std_wall_clock_read_native(VM& /*tvm*/, NativeInOut inout) {
+inline NativeResult std_wall_clock_read_native(VM& tvm, NativeInOut inout) {
     const auto args = inout.args();
     assert(args.empty());
     (void)args;
     const auto val = time_point_cast<DurationInt>(
         std::chrono::high_resolution_clock::now()
     );
-    inout.return_value() = Value{std::bit_cast<int_t>(val)};
+    inout.return_value() = make_int(tvm, std::bit_cast<int_t>(val));
     return NativeResult::SUCCESS;
 }
 
@@ -146,10 +149,15 @@ inline NativeResult std_sleep_for_native(VM& /*tvm*/, NativeInOut inout) {
     return NativeResult::SUCCESS;
 }
 
-inline NativeResult std_println_native(VM& /*tvm*/, NativeInOut inout) {
+inline NativeResult std_println_native(VM& tvm, NativeInOut inout) {
     const auto args = inout.args();
     assert(args.size() == 1);
-    fmt::print(FMT_STRING("{}\n"), args[0]);
+    auto* output = tvm.get_options().output;
+    fmt::print(
+        output != nullptr ? output : stdout,
+        FMT_STRING("{}\n"),
+        args[0]
+    );
     inout.return_value() = Value{val_nil};
     return NativeResult::SUCCESS;
 }
@@ -183,20 +191,71 @@ float_sqrt_native(VM& /*tvm*/, NativeInOut inout) {
     return result;
 }
 
-[[nodiscard]] inline constexpr std::tuple<bool, size_t>
+[[nodiscard]] inline constexpr std::tuple<bool, bool, size_t>
 CallFrame::read_closure_operand() noexcept {
-    auto [is_local, index, len] = ::tx::read_closure_operand(instruction_ptr);
+    auto [is_local, is_value, index, len] =
+        ::tx::read_closure_operand(instruction_ptr);
     std::advance(instruction_ptr, len);
-    return std::make_tuple(is_local, index);
+    return std::make_tuple(is_local, is_value, index);
 }
 
 inline VM::VM(VMOptions opts, const Allocator& alloc) noexcept
+        : VM(opts, alloc, nullptr) {}
+
+inline VM::VM(
+    VMOptions opts,
+    const Allocator& alloc,
+    const Program& prog
+) noexcept
+        : VM(opts, alloc, &prog) {
+    assert(prog.is_compiled());
+    // Same globals as the program, the natives are already defined and their
+    // names interned with the program strings
+    const auto& program_vm = prog.tvm;
+    const auto count = program_vm.global_values.size();
+    DynArray<Value> names(*this, count, Value{val_none});
+    for (const auto& [name, idx] : program_vm.global_indices) {
+        names[size_cast(idx.as_int())] = name;
+    }
+    for (auto i = global_values.size(); i < count; ++i) {
+        const auto& signature = program_vm.global_signatures[i];
+        (void)add_global(
+            names[i],
+            Global{
+                .is_defined = signature.is_defined,
+                .is_const = signature.is_const,
+                .function_kind = signature.function_kind,
+                .type_set = signature.type_set.copy(*this),
+            },
+            Value{val_none}
+        );
+    }
+    names.destroy(*this);
+}
+
+inline VM::VM(
+    VMOptions opts,
+    const Allocator& alloc,
+    const Program* prog
+) noexcept
         : options(opts)
-        , allocator(alloc) {
+        , allocator(alloc)
+        , program(prog) {
     if constexpr (!IS_DEBUG_BUILD) {
         frames.reserve(*this, START_FRAMES);
         stack.reserve(*this, START_STACK);
     }
+    // The functions of a shared program are not written, and traced
+    // executions show every instruction
+    if constexpr (HAS_JIT) {
+        if (program == nullptr && !options.trace_execution) {
+            switch (options.jit_mode) {
+                case JitMode::OFF: break;
+                case JitMode::HOT: jit_threshold = JIT_HOT_THRESHOLD; break;
+                case JitMode::FORCE: jit_threshold = 1; break;
+            }
+        }
+    }
 
     // FIXME: detect signature automatically at compile time
     define_native(
@@ -351,14 +410,33 @@ inline constexpr VM::~VM() noexcept {
     for (auto& global : global_signatures) { global.destroy(*this); }
     global_signatures.destroy(*this);
     strings.destroy(*this);
+    if constexpr (HAS_DEBUG_FEATURES) {
+        if (options.trace_gc) { print_gc_pauses(*this); }
+    }
     free_objects(*this, objects);
+    free_objects(*this, old_objects);
     gray_stack.destroy(*this);
+    remembered_set.destroy(*this);
+    minor_gc_pauses.destroy(*this);
+    major_gc_pauses.destroy(*this);
+}
+
+inline constexpr MemoryStats VM::get_memory_stats() const noexcept {
+    return MemoryStats{
+        .bytes_allocated = bytes_allocated,
+        .next_gc = next_gc,
+        .minor_gc_count = minor_gc_count,
+        .major_gc_count = major_gc_count,
+        .objects = object_stats,
+        .allocator = allocator.get_stats(),
+    };
 }
 
 inline constexpr void VM::reset_stack() noexcept {
     stack.clear();
     frames.clear();
     open_upvalues = nullptr;
+    previous_opcode = OpCode::END;
     if constexpr (IS_DEBUG_BUILD) {
         stack.destroy(*this);
         frames.destroy(*this);
@@ -398,8 +476,27 @@ inline InterpretResult
 VM::interpret(std::string_view file_path, std::string_view source) noexcept {
     ObjFunction* function = compile(file_path, source);
     if (function == nullptr) { return InterpretResult::COMPILE_ERROR; }
-    push(Value{function});
-    auto* closure = make_closure(*this, *function);
+    return run_script(*function);
+}
+
+inline InterpretResult VM::interpret_image(
+    std::string_view image_path,
+    std::span<const char> image
+) noexcept {
+    ObjFunction* function = read_image(*this, image_path, image);
+    if (function == nullptr) { return InterpretResult::COMPILE_ERROR; }
+    return run_script(*function);
+}
+
+inline InterpretResult VM::interpret_program() noexcept {
+    assert(program != nullptr);
+    return run_script(*program->script);
+}
+
+inline InterpretResult VM::run_script(ObjFunction& function) noexcept {
+    ensure_stack_space(1);
+    push(Value{&function});
+    auto* closure = make_closure(*this, function);
     pop();
     push(Value{closure});
     (void)call(*closure, 0);
@@ -438,12 +535,17 @@ inline void VM::define_native(
     assert(stack.empty());
     ensure_stack_space(2);
     push(Value{make_string(*this, false, name)});
-    push(Value{allocate_object<ObjNative>(*this, fun)});
+    push(Value{allocate_object<ObjNative>(
+        *this,
+        fun,
+        stack[0].as_object().as<ObjString>()
+    )});
     add_global(
         stack[0],
         Global{
             .is_defined = true,
             .is_const = true,
+            .function_kind = FunctionKind::NATIVE,
             .type_set = std::move(type_set),
         },
         stack[1]
@@ -453,7 +555,12 @@ inline void VM::define_native(
 }
 
 inline constexpr void VM::ensure_stack_space(size_t needed) noexcept {
-    if (stack.capacity() >= needed) { return; }
+    if (stack.capacity() >= needed) [[likely]] { return; }
+    grow_stack(needed);
+}
+
+// Kept out of line so that the calls flattened into run_loop stay small
+[[gnu::noinline]] inline void VM::grow_stack(size_t needed) noexcept {
     auto* old = stack.begin();
     if constexpr (IS_DEBUG_BUILD) {
         stack.reserve(*this, needed);
@@ -477,9 +584,10 @@ inline constexpr void VM::ensure_stack_space(size_t needed) noexcept {
     }
 }
 
+template <bool PROFILE>
 [[nodiscard]] inline constexpr bool
 VM::call(ObjClosure& closure, size_t arg_c) noexcept {
-    // TODO: make this a compile time error
+    // Only reached when the type of the callee is not known at compile time
     if (arg_c != closure.function.arity) [[unlikely]] {
         runtime_error(
             "Expected {:d} arguments but got {:d}.",
@@ -488,6 +596,13 @@ VM::call(ObjClosure& closure, size_t arg_c) noexcept {
         );
         return false;
     }
+    return call_closure<PROFILE>(closure, arg_c);
+}
+
+template <bool PROFILE>
+[[nodiscard]] inline constexpr bool
+VM::call_closure(ObjClosure& closure, size_t arg_c) noexcept {
+    assert(arg_c == closure.function.arity);
     if (frames.size() == MAX_FRAMES) [[unlikely]] {
         runtime_error("Stack overflow.");
         return false;
@@ -500,36 +615,21 @@ VM::call(ObjClosure& closure, size_t arg_c) noexcept {
         closure.function.chunk.code.begin(),
         std::prev(stack.end(), arg_c + 1)
     );
+    if constexpr (PROFILE) { profiler->enter_function(closure.function); }
     return true;
 }
 
-[[nodiscard]] inline constexpr bool
+template <bool PROFILE>
+[[nodiscard]] inline TX_VALUE_CONSTEXPR bool
 VM::call_value(Value callee, size_t arg_c) noexcept {
     if (callee.is_object()) [[likely]] {
         auto& obj = callee.as_object();
         switch (obj.type) {
             using enum Obj::ObjType;
-            case CLOSURE: return call(obj.as<ObjClosure>(), arg_c);
-            case NATIVE: {
-                auto& native = obj.as<ObjNative>();
-                auto success = std::invoke(
-                    native.function,
-                    *this,
-                    NativeInOut(std::prev(stack.end(), arg_c + 1), arg_c + 1)
-                );
-                if (success == NativeResult::SUCCESS) [[likely]] {
-                    // Return value already put in right slot by native
-                    // func. Do not erase it :)
-                    stack.erase(std::prev(stack.cend(), arg_c), stack.cend());
-                    return true;
-                }
-                const auto& return_value = *std::prev(stack.cend(), arg_c + 1);
-                runtime_error(
-                    FMT_STRING("{:s}"),
-                    return_value.as_object().as<ObjString>()
-                );
-                return false;
-            }
+            case CLOSURE:
+                return call<PROFILE>(obj.as<ObjClosure>(), arg_c);
+            case NATIVE:
+                return call_native<PROFILE>(obj.as<ObjNative>(), arg_c);
                 // clang-format off
             [[unlikely]] default : break;
                 // clang-format on
@@ -540,6 +640,72 @@ VM::call_value(Value callee, size_t arg_c) noexcept {
     return false;
 }
 
+template <bool PROFILE>
+[[nodiscard]] inline bool
+VM::call_native(ObjNative& native, size_t arg_c) noexcept {
+    if constexpr (PROFILE) { profiler->enter_native(native); }
+    auto success = std::invoke(
+        native.function,
+        *this,
+        NativeInOut(std::prev(stack.end(), arg_c + 1), arg_c + 1)
+    );
+    if constexpr (PROFILE) { profiler->leave_native(); }
+    if (success == NativeResult::SUCCESS) [[likely]] {
+        // Return value already put in right slot by native
+        // func. Do not erase it :)
+        if (arg_c > 0) {
+            stack.erase(std::prev(stack.cend(), arg_c), stack.cend());
+        }
+        return true;
+    }
+    const auto& return_value = *std::prev(stack.cend(), arg_c + 1);
+    runtime_error(
+        FMT_STRING("{:s}"),
+        return_value.as_object().as<ObjString>()
+    );
+    return false;
+}
+
+[[nodiscard]] inline ObjClosure*
+VM::push_global_callee(size_t index, size_t arg_c) noexcept {
+    const auto value = global_values[index];
+    // Only when an earlier script failed before defining it
+    if (value.is_none()) [[unlikely]] {
+        const auto name = get_global_name(index);
+        runtime_error("Undefined variable '{}'.", name);
+        return nullptr;
+    }
+    // Shift the arguments into the slot reserved by the compiler
+    push(value);
+    auto* callee = std::prev(stack.end(), arg_c + 1);
+    for (auto* arg = std::prev(stack.end()); arg != callee; --arg) {
+        *arg = *std::prev(arg);
+    }
+    *callee = value;
+    return &value.as_object().as<ObjClosure>();
+}
+
+template <bool PROFILE>
+[[nodiscard]] bool VM::tail_call(Value callee, size_t arg_c) noexcept {
+    if (!callee.is_object() || !callee.as_object().is_closure()) {
+        // Natives and errors, the RETURN that follows returns the result
+        return call_value<PROFILE>(callee, arg_c);
+    }
+    auto& closure = callee.as_object().template as<ObjClosure>();
+    if (arg_c != closure.function.arity) [[unlikely]] {
+        return call<PROFILE>(closure, arg_c);
+    }
+    // Move the callee and the arguments over the frame of the caller
+    auto* slots = frames.back().slots;
+    close_upvalues(slots);
+    std::move(std::prev(stack.end(), arg_c + 1), stack.end(), slots);
+    const auto* slots_end = std::next(slots, arg_c + 1);
+    if (slots_end != stack.end()) { stack.erase(slots_end, stack.end()); }
+    frames.pop_back();
+    if constexpr (PROFILE) { profiler->leave_function(); }
+    return call_closure<PROFILE>(closure, arg_c);
+}
+
 [[nodiscard]] inline ObjUpvalue& VM::capture_upvalue(Value* local) noexcept {
     ObjUpvalue* prev_upvalue = nullptr;
     ObjUpvalue* upvalue = open_upvalues;
@@ -563,6 +729,7 @@ inline constexpr void VM::close_upvalues(const Value* last) noexcept {
         ObjUpvalue* upvalue = open_upvalues;
         upvalue->closed = *upvalue->location;
         upvalue->location = &upvalue->closed;
+        write_barrier(*this, *upvalue, upvalue->closed);
         open_upvalues = upvalue->next_upvalue;
     }
 }
@@ -570,7 +737,7 @@ inline constexpr void VM::close_upvalues(const Value* last) noexcept {
 [[nodiscard]] inline constexpr bool VM::negate_op() noexcept {
     Value result{val_none};
     if (peek(0).is_int()) {
-        result = Value(-pop().as_int());
+        result = make_int(*this, -pop().as_int());
     } else if (peek(0).is_float()) {
         result = Value(-pop().as_float());
     } else [[unlikely]] {
@@ -582,6 +749,15 @@ inline constexpr void VM::close_upvalues(const Value* last) noexcept {
     return false;
 }
 
+template <typename T>
+[[nodiscard]] inline constexpr Value VM::make_number_result(T val) noexcept {
+    if constexpr (std::is_same_v<T, int_t>) {
+        return make_int(*this, val);
+    } else {
+        return Value(val);
+    }
+}
+
 template <template <typename> typename Op>
 [[nodiscard]] inline constexpr bool VM::binary_op() noexcept {
     if (!peek(0).is_number() || !peek(1).is_number()) [[unlikely]] {
@@ -594,7 +770,7 @@ template <template <typename> typename Op>
     Value result{val_none};
     if (lhs.is_int() && rhs.is_int()) {
         Op<int_t> bop;
-        result = Value(bop(lhs.as_int(), rhs.as_int()));
+        result = make_number_result(bop(lhs.as_int(), rhs.as_int()));
     } else {
         float_t left = lhs.as_float_force();
         float_t rght = rhs.as_float_force();
@@ -605,6 +781,26 @@ template <template <typename> typename Op>
     return false;
 }
 
+// Operand types already checked by the compiler
+template <template <typename> typename Op>
+inline constexpr void VM::binary_op_int() noexcept {
+    assert(peek(0).is_int() && peek(1).is_int());  // NOLINT(*-decay)
+    const auto rhs = pop().as_int();
+    const auto lhs = pop().as_int();
+    Op<int_t> bop;
+    push(make_number_result(bop(lhs, rhs)));
+}
+
+// Operand types already checked by the compiler, Int values are converted
+template <template <typename> typename Op>
+inline constexpr void VM::binary_op_float() noexcept {
+    assert(peek(0).is_number() && peek(1).is_number());  // NOLINT(*-decay)
+    const auto rhs = pop().as_float_force();
+    const auto lhs = pop().as_float_force();
+    Op<float_t> bop;
+    push(Value(bop(lhs, rhs)));
+}
+
 inline void VM::print_stack() const noexcept {
     fmt::print(FMT_STRING("          "));
     for (const auto& slot : stack) { fmt::print(FMT_STRING("[ {} ]"), slot); }
@@ -616,30 +812,38 @@ inline void CallFrame::print_instruction() const noexcept {
 }
 
 // FIXME: Make sure this does not bloat the binary in realease mode
-inline void VM::assert_stack_effect(const ByteCode* iptr) const noexcept {
-    static size_t previous_size = 0;
-    static auto previous_opc = OpCode::END;
-    static size_t previous_operand = 0;
+// nullptr when instructions ran as native code, to skip the next check
+inline void VM::assert_stack_effect(const ByteCode* iptr) noexcept {
+    if (iptr == nullptr) {
+        previous_opcode = OpCode::END;
+        return;
+    }
     const size_t current_size = stack.size();
-    const auto delta = current_size - previous_size;
+    const auto delta = current_size - previous_stack_size;
 
-    switch (previous_opc) {
+    switch (previous_opcode) {
         using enum OpCode;
         // FIXME: verify CALL and RETURN if possible
         case END:
         case CALL:
+        case CALL_CLOSURE:
+        case CALL_NATIVE:
+        case CALL_GLOBAL:
+        case TAIL_CALL:
+        case TAIL_CALL_GLOBAL:
         case RETURN: break;
         default: {
             assert(
-                delta == get_opcode_stack_effect(previous_opc, previous_operand)
+                delta
+                == get_opcode_stack_effect(previous_opcode, previous_operand)
             );
             (void)previous_operand;
             (void)delta;
         }
     }
-    previous_size = current_size;
-    previous_opc = (*iptr).as_opcode();
-    const auto operand_size = get_byte_count_following_opcode(previous_opc);
+    previous_stack_size = current_size;
+    previous_opcode = (*iptr).as_opcode();
+    const auto operand_size = get_byte_count_following_opcode(previous_opcode);
     if (operand_size == 1) {
         previous_operand = ::tx::read_multibyte_operand<1>(std::next(iptr));
     } else if (operand_size == 2) {
@@ -649,7 +853,7 @@ inline void VM::assert_stack_effect(const ByteCode* iptr) const noexcept {
     }
 }
 
-inline void VM::debug_trace(const ByteCode* iptr) const noexcept {
+inline void VM::debug_trace(const ByteCode* iptr) noexcept {
     if constexpr (HAS_DEBUG_FEATURES) {
         if (options.trace_execution) {
             print_stack();
@@ -670,6 +874,16 @@ inline void VM::do_get_local(CallFrame*& frame) noexcept {
     push(frame->slots[slot]);
 }
 
+template <template <typename> typename Op>
+inline void VM::do_local_constant_op_int(CallFrame*& frame) noexcept {
+    const auto slot = frame->read_multibyte_operand<1>();
+    const auto constant = frame->read_constant<1>();
+    assert(frame->slots[slot].is_int() && constant.is_int());
+    Op<int_t> bop;
+    push(make_number_result(bop(frame->slots[slot].as_int(), constant.as_int()))
+    );
+}
+
 template <u8 N>
 inline void VM::do_set_local(CallFrame*& frame) noexcept {
     const auto slot = frame->read_multibyte_operand<N>();
@@ -714,28 +928,46 @@ inline bool VM::do_set_global(CallFrame*& frame) noexcept {
 template <u8 N>
 inline void VM::do_get_upvalue(CallFrame*& frame) noexcept {
     const auto slot = frame->read_multibyte_operand<N>();
-    push(*frame->closure.upvalues[slot]->location);
+    const auto& upvalue =
+        frame->closure.upvalues[slot].as_object().template as<ObjUpvalue>();
+    push(*upvalue.location);
 }
 
 template <u8 N>
 inline void VM::do_set_upvalue(CallFrame*& frame) noexcept {
     const auto slot = frame->read_multibyte_operand<N>();
-    *frame->closure.upvalues[slot]->location = peek(0);
+    auto& upvalue =
+        frame->closure.upvalues[slot].as_object().template as<ObjUpvalue>();
+    *upvalue.location = peek(0);
+    if (upvalue.location == &upvalue.closed) {
+        write_barrier(*this, upvalue, upvalue.closed);
+    }
 }
 
 template <u8 N>
-inline void VM::do_closure(CallFrame*& frame) noexcept {
+inline void VM::do_get_upvalue_copy(CallFrame*& frame) noexcept {
+    const auto slot = frame->read_multibyte_operand<N>();
+    push(frame->closure.upvalues[slot]);
+}
+
+template <u8 N>
+void VM::do_closure(CallFrame*& frame) noexcept {
     auto& fun = frame->read_constant<N>().as_object().template as<ObjFunction>(
     );
     auto* closure = make_closure(*this, fun);
     push(Value(closure));
-    for (auto& upvalue : closure->upvalues) {
-        auto [is_local, index] = frame->read_closure_operand();
-        if (is_local) {
-            upvalue = &capture_upvalue(std::next(frame->slots, index));
-        } else {
+    for (auto& upvalue : closure->get_upvalues()) {
+        auto [is_local, is_value, index] = frame->read_closure_operand();
+        if (!is_local) {
+            // Either the upvalue or the copied value of the enclosing closure
             upvalue = frame->closure.upvalues[index];
+        } else if (is_value) {
+            upvalue = frame->slots[index];
+        } else {
+            upvalue = Value{&capture_upvalue(std::next(frame->slots, index))};
         }
+        // Capturing can collect and promote the closure
+        write_barrier(*this, *closure, upvalue);
     }
 }
 
@@ -748,9 +980,44 @@ inline void VM::do_end_scope(CallFrame*& frame) noexcept {
     push(result);
 }
 
-// clang-format off
+template <bool COUNT>
+[[nodiscard]] inline constexpr bool VM::is_jit_entry(CallFrame& frame
+) noexcept {
+    if (jit_threshold == 0) { return false; }
+    auto& function = frame.closure.function;
+    if (function.jit_code != nullptr) { return true; }
+    if constexpr (COUNT) { return ++function.hotness >= jit_threshold; }
+    return false;
+}
+
+// Kept out of line, like do_closure()
+[[gnu::noinline]] inline void VM::run_jit(CallFrame*& frame) noexcept {
+    auto& function = frame->closure.function;
+    if (function.jit_code == nullptr) {
+        function.jit_code = jit_compile(*this, function);
+        if (function.jit_code == nullptr) [[unlikely]] {
+            function.hotness = 0;
+            return;
+        }
+    }
+    jit_run(*this, *function.jit_code, *frame);
+    if constexpr (IS_DEBUG_BUILD) { assert_stack_effect(nullptr); }
+}
+
 // TX_VM_CONSTEXPR
-[[gnu::flatten]] inline InterpretResult VM::run() noexcept {
+inline InterpretResult VM::run() noexcept {
+    previous_opcode = OpCode::END;
+    if (profiler == nullptr) { return run_loop<false>(); }
+    assert(frames.size() == 1);
+    profiler->start_run(frames.back().closure.function);
+    const auto result = run_loop<true>();
+    profiler->stop_run();
+    return result;
+}
+
+// clang-format off
+template <bool PROFILE>
+[[gnu::flatten]] inline InterpretResult VM::run_loop() noexcept {
     #ifdef TX_ENABLE_COMPUTED_GOTO
         __extension__
         static void* dispatch_table[] = {
@@ -764,6 +1031,9 @@ inline void VM::do_end_scope(CallFrame*& frame) noexcept {
             do { \
                 debug_trace(frame->instruction_ptr); \
                 instruction = frame->read_byte().as_opcode(); \
+                if constexpr (PROFILE) { \
+                    profiler->start_instruction(instruction); \
+                } \
                 (__extension__( \
                     {goto *dispatch_table[to_underlying(instruction)];} \
                 )); \
@@ -772,17 +1042,29 @@ inline void VM::do_end_scope(CallFrame*& frame) noexcept {
         #define TX_VM_DISPATCH  \
             debug_trace(frame->instruction_ptr); \
             instruction = frame->read_byte().as_opcode(); \
+            if constexpr (PROFILE) { \
+                profiler->start_instruction(instruction); \
+            } \
             switch (instruction)
         // NOLINTNEXTLINE(cppcoreguidelines-macro-usage)
         #define TX_VM_CASE(name) case name
         // NOLINTNEXTLINE(cppcoreguidelines-macro-usage)
         #define TX_VM_BREAK() break
     #endif
+    // Continue in the native code of the function of the frame, if any, the
+    // calls and loop iterations of the COUNT entries make functions hot
+    #define TX_VM_ENTER_JIT(COUNT) \
+        do { \
+            if constexpr (HAS_JIT && !PROFILE) { \
+                if (is_jit_entry<COUNT>(*frame)) { run_jit(frame); } \
+            } \
+        } while (false)
     // clang-format on
 
     // Try to force the compiler to store it in a register
     CallFrame* frame = &frames.back();
     OpCode instruction = OpCode::END;
+    TX_VM_ENTER_JIT(true);
     for (;;) {
         TX_VM_DISPATCH {
             using enum OpCode;
@@ -874,6 +1156,14 @@ inline void VM::do_end_scope(CallFrame*& frame) noexcept {
                 do_set_upvalue<3>(frame);
                 TX_VM_BREAK();
             }
+            TX_VM_CASE(GET_UPVALUE_COPY) : {
+                do_get_upvalue_copy<1>(frame);
+                TX_VM_BREAK();
+            }
+            TX_VM_CASE(GET_UPVALUE_COPY_LONG) : {
+                do_get_upvalue_copy<3>(frame);
+                TX_VM_BREAK();
+            }
             TX_VM_CASE(EQUAL) : {
                 const Value rhs = pop();
                 const Value lhs = pop();
@@ -939,6 +1229,95 @@ inline void VM::do_end_scope(CallFrame*& frame) noexcept {
                 }
                 TX_VM_BREAK();
             }
+            TX_VM_CASE(EQUAL_INT) : {
+                binary_op_int<std::equal_to>();
+                TX_VM_BREAK();
+            }
+            TX_VM_CASE(NOT_EQUAL_INT) : {
+                binary_op_int<std::not_equal_to>();
+                TX_VM_BREAK();
+            }
+            TX_VM_CASE(GREATER_INT) : {
+                binary_op_int<std::greater>();
+                TX_VM_BREAK();
+            }
+            TX_VM_CASE(GREATER_EQUAL_INT) : {
+                binary_op_int<std::greater_equal>();
+                TX_VM_BREAK();
+            }
+            TX_VM_CASE(LESS_INT) : {
+                binary_op_int<std::less>();
+                TX_VM_BREAK();
+            }
+            TX_VM_CASE(LESS_EQUAL_INT) : {
+                binary_op_int<std::less_equal>();
+                TX_VM_BREAK();
+            }
+            TX_VM_CASE(ADD_INT) : {
+                binary_op_int<std::plus>();
+                TX_VM_BREAK();
+            }
+            TX_VM_CASE(SUBSTRACT_INT) : {
+                binary_op_int<std::minus>();
+                TX_VM_BREAK();
+            }
+            TX_VM_CASE(MULTIPLY_INT) : {
+                binary_op_int<std::multiplies>();
+                TX_VM_BREAK();
+            }
+            TX_VM_CASE(DIVIDE_INT) : {
+                if (peek(0).as_int() == 0) [[unlikely]] {
+                    runtime_error("Integer division by zero.");
+                    return InterpretResult::RUNTIME_ERROR;
+                }
+                binary_op_int<std::divides>();
+                TX_VM_BREAK();
+            }
+            TX_VM_CASE(GREATER_FLOAT) : {
+                binary_op_float<std::greater>();
+                TX_VM_BREAK();
+            }
+            TX_VM_CASE(GREATER_EQUAL_FLOAT) : {
+                binary_op_float<std::greater_equal>();
+                TX_VM_BREAK();
+            }
+            TX_VM_CASE(LESS_FLOAT) : {
+                binary_op_float<std::less>();
+                TX_VM_BREAK();
+            }
+            TX_VM_CASE(LESS_EQUAL_FLOAT) : {
+                binary_op_float<std::less_equal>();
+                TX_VM_BREAK();
+            }
+            TX_VM_CASE(ADD_FLOAT) : {
+                binary_op_float<std::plus>();
+                TX_VM_BREAK();
+            }
+            TX_VM_CASE(SUBSTRACT_FLOAT) : {
+                binary_op_float<std::minus>();
+                TX_VM_BREAK();
+            }
+            TX_VM_CASE(MULTIPLY_FLOAT) : {
+                binary_op_float<std::multiplies>();
+                TX_VM_BREAK();
+            }
+            TX_VM_CASE(DIVIDE_FLOAT) : {
+                binary_op_float<std::divides>();
+                TX_VM_BREAK();
+            }
+            TX_VM_CASE(EQUAL_STRING) : {
+                // Strings are interned, compare addresses
+                const auto& rhs = pop().as_object();
+                const auto& lhs = pop().as_object();
+                push(Value(&lhs == &rhs));
+                TX_VM_BREAK();
+            }
+            TX_VM_CASE(NOT_EQUAL_STRING) : {
+                const auto& rhs = pop().as_object();
+                const auto& lhs = pop().as_object();
+                push(Value(&lhs != &rhs));
+                TX_VM_BREAK();
+            }
             TX_VM_CASE(NOT) : {
                 push(Value(pop().is_falsey()));
                 TX_VM_BREAK();
@@ -971,22 +1350,84 @@ inline void VM::do_end_scope(CallFrame*& frame) noexcept {
                     frame->instruction_ptr,
                     offset
                 );
+                TX_VM_ENTER_JIT(true);
                 TX_VM_BREAK();
             }
             TX_VM_CASE(CALL) : {
                 auto arg_count = frame->read_multibyte_operand<1>();
-                if (!call_value(peek(arg_count), arg_count)) [[unlikely]] {
+                if (!call_value<PROFILE>(peek(arg_count), arg_count))
+                    [[unlikely]] {
+                    return InterpretResult::RUNTIME_ERROR;
+                }
+                frame = &frames.back();
+                TX_VM_ENTER_JIT(true);
+                TX_VM_BREAK();
+            }
+            TX_VM_CASE(CALL_CLOSURE) : {
+                auto arg_count = frame->read_multibyte_operand<1>();
+                auto& closure =
+                    peek(arg_count).as_object().template as<ObjClosure>();
+                if (!call_closure<PROFILE>(closure, arg_count)) [[unlikely]] {
                     return InterpretResult::RUNTIME_ERROR;
                 }
                 frame = &frames.back();
+                TX_VM_ENTER_JIT(true);
+                TX_VM_BREAK();
+            }
+            TX_VM_CASE(CALL_NATIVE) : {
+                auto arg_count = frame->read_multibyte_operand<1>();
+                auto& native =
+                    peek(arg_count).as_object().template as<ObjNative>();
+                if (!call_native<PROFILE>(native, arg_count)) [[unlikely]] {
+                    return InterpretResult::RUNTIME_ERROR;
+                }
+                TX_VM_ENTER_JIT(false);
+                TX_VM_BREAK();
+            }
+            TX_VM_CASE(CALL_GLOBAL) : {
+                auto arg_count = frame->read_multibyte_operand<1>();
+                auto index = frame->read_multibyte_operand<1>();
+                auto* closure = push_global_callee(index, arg_count);
+                if (closure == nullptr
+                    || !call_closure<PROFILE>(*closure, arg_count))
+                    [[unlikely]] {
+                    return InterpretResult::RUNTIME_ERROR;
+                }
+                frame = &frames.back();
+                TX_VM_ENTER_JIT(true);
+                TX_VM_BREAK();
+            }
+            TX_VM_CASE(TAIL_CALL) : {
+                auto arg_count = frame->read_multibyte_operand<1>();
+                if (!tail_call<PROFILE>(peek(arg_count), arg_count))
+                    [[unlikely]] {
+                    return InterpretResult::RUNTIME_ERROR;
+                }
+                frame = &frames.back();
+                TX_VM_ENTER_JIT(true);
+                TX_VM_BREAK();
+            }
+            TX_VM_CASE(TAIL_CALL_GLOBAL) : {
+                auto arg_count = frame->read_multibyte_operand<1>();
+                auto index = frame->read_multibyte_operand<1>();
+                auto* closure = push_global_callee(index, arg_count);
+                if (closure == nullptr
+                    || !tail_call<PROFILE>(Value{closure}, arg_count))
+                    [[unlikely]] {
+                    return InterpretResult::RUNTIME_ERROR;
+                }
+                frame = &frames.back();
+                TX_VM_ENTER_JIT(true);
                 TX_VM_BREAK();
             }
             TX_VM_CASE(CLOSURE) : {
                 do_closure<1>(frame);
+                TX_VM_ENTER_JIT(false);
                 TX_VM_BREAK();
             }
             TX_VM_CASE(CLOSURE_LONG) : {
                 do_closure<3>(frame);
+                TX_VM_ENTER_JIT(false);
                 TX_VM_BREAK();
             }
             TX_VM_CASE(END_SCOPE) : {
@@ -1002,6 +1443,7 @@ inline void VM::do_end_scope(CallFrame*& frame) noexcept {
                 const auto* frame_slots = frame->slots;
                 close_upvalues(frame_slots);
                 frames.pop_back();
+                if constexpr (PROFILE) { profiler->leave_function(); }
                 if (frames.empty()) [[unlikely]] {
                     pop();
                     assert(stack.empty());
@@ -1010,9 +1452,34 @@ inline void VM::do_end_scope(CallFrame*& frame) noexcept {
                 stack.erase(frame_slots, stack.end());
                 push(result);
                 frame = &frames.back();
+                TX_VM_ENTER_JIT(false);
                 TX_VM_BREAK();
             }
             TX_VM_CASE(END) : { unreachable(); }
+            TX_VM_CASE(GET_LOCAL_GET_LOCAL) : {
+                const auto first = frame->read_multibyte_operand<1>();
+                const auto second = frame->read_multibyte_operand<1>();
+                push(frame->slots[first]);
+                push(frame->slots[second]);
+                TX_VM_BREAK();
+            }
+            TX_VM_CASE(GET_LOCAL_CONSTANT_ADD_INT) : {
+                do_local_constant_op_int<std::plus>(frame);
+                TX_VM_BREAK();
+            }
+            TX_VM_CASE(GET_LOCAL_CONSTANT_SUBSTRACT_INT) : {
+                do_local_constant_op_int<std::minus>(frame);
+                TX_VM_BREAK();
+            }
+            TX_VM_CASE(LESS_INT_JUMP_IF_FALSE) : {
+                binary_op_int<std::less>();
+                auto offset = frame->read_multibyte_operand<2>();
+                frame->instruction_ptr = std::next(
+                    frame->instruction_ptr,
+                    static_cast<i64>(peek(0).is_falsey()) * offset
+                );
+                TX_VM_BREAK();
+            }
         }
     }
     unreachable();
@@ -1021,6 +1488,7 @@ inline void VM::do_end_scope(CallFrame*& frame) noexcept {
     #undef TX_VM_DISPATCH
     #undef TX_VM_CASE
     #undef TX_VM_BREAK
+    #undef TX_VM_ENTER_JIT
     // clang-format on
 }
 